@@ -0,0 +1,1564 @@
+/*
+ * ChanMux NIC driver host benchmark
+ *
+ * Runs the RX loop and the TX RPC of the driver against an in-memory ChanMux
+ * and network stack, so the data path can be measured off-target. The RX
+ * frame parser is also measured on its own.
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_Error.h"
+#include "OS_Dataport.h"
+#include "ChanMux/ChanMuxCommon.h"
+#include "ChanMuxNic.h"
+#include "network/OS_NetworkTypes.h"
+#include "network/OS_NetworkStackTypes.h"
+#include "chanmux_nic_drv_api.h"
+#include "chanmux_nic_rx_parser.h"
+#include "chanmux_nic_crc32.h"
+#include "chanmux_nic_csum.h"
+#include <sel4/sel4.h>
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_RING_ELEMENTS     16
+#define BENCH_PORT_SIZE         4096
+#define BENCH_STACK_PORT_SIZE   (64 * 1024 + 64) // a TSO segment fits
+#define BENCH_CTRL_PORT_SIZE    64
+#define BENCH_FIFO_SIZE         (8 * 1024 * 1024)
+#define BENCH_TX_QUEUE_MAX      (1024 * 1024)
+#define BENCH_TX_TRACE          (1 << 17)
+// the benchmark puts TX frames up to this length into priority class 0
+#define BENCH_TX_SMALL_LEN      64
+// with several RX clients or checksum offload, the RX frames are IPv4/UDP of
+// this many flows
+#define BENCH_RX_FLOWS          64
+#define BENCH_RX_FLOW_SEQ_OFS   42 // behind the UDP header
+// with LRO, the RX frames are IPv4/TCP segments of the flows
+#define BENCH_RX_TCP_HDR_LEN    54
+
+//------------------------------------------------------------------------------
+// in-memory ChanMux and network stack
+//------------------------------------------------------------------------------
+static uint8_t data_port_read[BENCH_PORT_SIZE];
+// in TX zero-copy mode, the network stack output starts with the ChanMux
+// write port and goes beyond it, so jumbo frames fit
+static uint8_t data_port_write[BENCH_STACK_PORT_SIZE];
+static uint8_t ctrl_port_read[BENCH_CTRL_PORT_SIZE];
+static uint8_t ctrl_port_write[BENCH_CTRL_PORT_SIZE];
+static OS_NetworkStack_RxBuffer_t
+stack_port_to[CHANMUX_NIC_DRV_RX_CLIENTS_MAX][BENCH_RING_ELEMENTS];
+static uint8_t stack_port_from[BENCH_STACK_PORT_SIZE];
+static uint8_t tx_queue[BENCH_TX_QUEUE_MAX];
+
+// OS_Dataport_t refers to the dataport pointer, as CAmkES provides it
+static void *data_port_read_buf = data_port_read;
+static void *data_port_write_buf = data_port_write;
+static void *ctrl_port_read_buf = ctrl_port_read;
+static void *ctrl_port_write_buf = ctrl_port_write;
+static void *stack_port_to_buf[CHANMUX_NIC_DRV_RX_CLIENTS_MAX] =
+{
+    stack_port_to[0], stack_port_to[1], stack_port_to[2], stack_port_to[3]
+};
+static void *stack_port_from_buf = stack_port_from;
+
+static struct
+{
+    uint8_t buf[BENCH_FIFO_SIZE];
+    size_t len;
+    size_t pos;
+    size_t chunk; // max bytes a read() returns
+} rx_fifo;
+
+static struct
+{
+    uint8_t rsp[64];
+    size_t len;
+} ctrl_fifo;
+
+// The peer parses the TX stream and checks the frames. Each frame starts
+// with a sequence number, frames of the same priority class must arrive in
+// order. The time from sending to arrival is measured per class. With TSO,
+// the frames are TCP segments of one flow per class instead, their headers
+// and data must continue the flow.
+static struct
+{
+    size_t chunk; // max bytes a write() takes, 0 is all
+    chanmux_nic_rx_parser_t parser;
+    uint8_t frame[0xFFFF];
+    size_t frames;
+    size_t bad;   // frames with unexpected content or out of order
+    bool csum;    // frames are IPv4/UDP, check their checksums
+    bool tcp;     // frames are IPv4/TCP from TSO
+    double csum_sec; // time spent checking, it does not count for the driver
+    uint32_t next_seq[2];
+    uint16_t next_ip_id[2];
+    double sent[BENCH_TX_TRACE];
+    double delay_sum[2];
+    double delay_max[2];
+    size_t delay_cnt[2];
+} tx_sink;
+
+static double now_sec(void);
+static bool frame_check_csum(const uint8_t *frame, size_t len);
+static bool frame_check_tcp(const uint8_t *frame, size_t len);
+static uint8_t rx_tcp_byte(unsigned int flow, uint32_t pos);
+static void tx_sink_check_tcp(const uint8_t *frame, size_t len);
+
+static struct
+{
+    size_t reads;
+    size_t writes;
+    size_t waits;
+    size_t notifies;
+    size_t yields;
+    size_t bytes_copied;
+    size_t rx_frames;
+    size_t rx_bytes;
+    size_t rx_bad; // frames on the wrong client or out of flow order
+    size_t rx_csum_ok; // frames with CHANMUX_NIC_DRV_RX_LEN_CSUM_OK
+    size_t tx_bytes;
+} cnt;
+
+// Each flow must stay on one RX client and keep its order there.
+static struct
+{
+    unsigned int clients;
+    bool tcp;    // frames are TCP segments, merged ones are checked
+    double check_sec; // time spent checking TCP, it does not count
+    int client[BENCH_RX_FLOWS]; // -1 until the first frame
+    uint32_t next_seq[BENCH_RX_FLOWS];
+    uint8_t frame[0x10000]; // a TCP frame, gathered from its slots
+} rx_flows;
+
+// memcpy() is declared as leaf function, volatile keeps the compiler from
+// dropping the updates around calls to it
+static volatile bool count_copies;
+static size_t stack_pos[CHANMUX_NIC_DRV_RX_CLIENTS_MAX];
+// MAC the peer reports and multicast groups the network stack has joined or
+// not for the RX filter
+static const uint8_t bench_mac[MAC_SIZE] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static const uint8_t bench_mcast_joined[MAC_SIZE] =
+{
+    0x01, 0x00, 0x5e, 0x00, 0x00, 0x01
+};
+static uint8_t bench_mcast_other[MAC_SIZE] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x02 };
+static uint16_t peer_features;
+static jmp_buf rx_done;
+
+void *__real_memcpy(void *dst, const void *src, size_t len);
+
+//------------------------------------------------------------------------------
+// the driver is linked with --wrap=memcpy, so every copy it does ends up here
+void *
+__wrap_memcpy(
+    void *dst,
+    const void *src,
+    size_t len)
+{
+    if (count_copies)
+    {
+        cnt.bytes_copied += len;
+    }
+    return __real_memcpy(dst, src, len);
+}
+
+//------------------------------------------------------------------------------
+// the driver copies frame data while it takes the checksum, this is counted
+// as a copy also
+uint64_t __real_chanmux_nic_csum_copy(void *dst, const void *src, size_t len,
+                                      uint64_t sum);
+
+uint64_t
+__wrap_chanmux_nic_csum_copy(
+    void *dst,
+    const void *src,
+    size_t len,
+    uint64_t sum)
+{
+    bool counting = count_copies;
+    if (counting)
+    {
+        cnt.bytes_copied += len;
+    }
+    count_copies = false;
+    sum = __real_chanmux_nic_csum_copy(dst, src, len, sum);
+    count_copies = counting;
+    return sum;
+}
+
+//------------------------------------------------------------------------------
+void
+seL4_Yield(void)
+{
+    cnt.yields++;
+}
+
+//------------------------------------------------------------------------------
+// check the flow of a frame a client got
+static void
+stack_check_flow(
+    unsigned int client,
+    const uint8_t *frame)
+{
+    unsigned int flow = (frame[29] - 1) % BENCH_RX_FLOWS;
+    const uint8_t *p = &frame[BENCH_RX_FLOW_SEQ_OFS];
+    uint32_t seq = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                   ((uint32_t)p[2] << 8) | p[3];
+
+    if (rx_flows.client[flow] < 0)
+    {
+        rx_flows.client[flow] = client;
+    }
+    // corrupted frames leave gaps, but nothing may go backwards
+    if ((rx_flows.client[flow] != (int)client) ||
+        (seq < rx_flows.next_seq[flow]))
+    {
+        cnt.rx_bad++;
+    }
+    rx_flows.next_seq[flow] = seq + 1;
+}
+
+//------------------------------------------------------------------------------
+// check a TCP frame a client got, it may have several segments merged by LRO.
+// Its checksums must be correct and the data must continue the flow.
+static void
+stack_check_tcp(
+    unsigned int client,
+    const uint8_t *frame,
+    size_t len)
+{
+    double check_start = now_sec();
+    unsigned int flow = (frame[29] - 1) % BENCH_RX_FLOWS;
+    uint32_t seq = ((uint32_t)frame[38] << 24) | ((uint32_t)frame[39] << 16) |
+                   ((uint32_t)frame[40] << 8) | frame[41];
+    size_t ip_len = ((size_t)frame[16] << 8) | frame[17];
+
+    bool ok = (ip_len + 14 == len) && frame_check_tcp(frame, len);
+    for (size_t i = BENCH_RX_TCP_HDR_LEN; ok && (i < len); i++)
+    {
+        ok = (frame[i] == rx_tcp_byte(flow, seq + i - BENCH_RX_TCP_HDR_LEN));
+    }
+    if (rx_flows.client[flow] < 0)
+    {
+        rx_flows.client[flow] = client;
+    }
+    // lost segments leave gaps, but nothing may go backwards
+    if (!ok || (rx_flows.client[flow] != (int)client) ||
+        (seq < rx_flows.next_seq[flow]))
+    {
+        cnt.rx_bad++;
+    }
+    rx_flows.next_seq[flow] = seq + (len - BENCH_RX_TCP_HDR_LEN);
+    rx_flows.check_sec += now_sec() - check_start;
+}
+
+//------------------------------------------------------------------------------
+// network stack side, consume all frames the driver has put into the ring of a
+// client. A chained frame is consumed once its last slot is there.
+static void
+stack_consume(
+    unsigned int client)
+{
+    OS_NetworkStack_RxBuffer_t *ring = stack_port_to[client];
+    size_t *pos = &stack_pos[client];
+
+    for (;;)
+    {
+        size_t len = 0;
+        size_t slots = 0;
+        size_t slot_len;
+        do
+        {
+            slot_len = ring[(*pos + slots) % BENCH_RING_ELEMENTS].len;
+            if ((0 == slot_len) || (slots >= BENCH_RING_ELEMENTS))
+            {
+                return;
+            }
+            len += slot_len & ~CHANMUX_NIC_DRV_RX_LEN_FLAGS;
+            slots++;
+        } while (slot_len & CHANMUX_NIC_DRV_RX_LEN_CHAINED);
+
+        if (rx_flows.tcp)
+        {
+            // the copy is part of the check, not of the driver
+            bool counting = count_copies;
+            count_copies = false;
+            size_t frame_len = 0;
+            for (size_t i = 0; i < slots; i++)
+            {
+                const OS_NetworkStack_RxBuffer_t *slot =
+                    &ring[(*pos + i) % BENCH_RING_ELEMENTS];
+                size_t n = slot->len & ~CHANMUX_NIC_DRV_RX_LEN_FLAGS;
+                memcpy(&rx_flows.frame[frame_len], slot->data, n);
+                frame_len += n;
+            }
+            stack_check_tcp(client, rx_flows.frame, frame_len);
+            count_copies = counting;
+        }
+        else if (rx_flows.clients > 1)
+        {
+            stack_check_flow(client, ring[*pos].data);
+        }
+        cnt.rx_frames++;
+        cnt.rx_bytes += len;
+        cnt.rx_csum_ok += (slot_len & CHANMUX_NIC_DRV_RX_LEN_CSUM_OK) ? 1 : 0;
+        while (slots-- > 0)
+        {
+            ring[*pos].len = 0;
+            *pos = (*pos + 1) % BENCH_RING_ELEMENTS;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+static void
+stack_notify(void)
+{
+    cnt.notifies++;
+    stack_consume(0);
+}
+
+//------------------------------------------------------------------------------
+static void
+stack_notify_1(void)
+{
+    cnt.notifies++;
+    stack_consume(1);
+}
+
+//------------------------------------------------------------------------------
+static void
+stack_notify_2(void)
+{
+    cnt.notifies++;
+    stack_consume(2);
+}
+
+//------------------------------------------------------------------------------
+static void
+stack_notify_3(void)
+{
+    cnt.notifies++;
+    stack_consume(3);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+data_read(
+    unsigned int id,
+    size_t len,
+    size_t *len_read)
+{
+    (void)id;
+
+    bool counting = count_copies;
+    count_copies = false;
+
+    cnt.reads++;
+    size_t n = rx_fifo.len - rx_fifo.pos;
+    n = (n > len) ? len : n;
+    n = (n > rx_fifo.chunk) ? rx_fifo.chunk : n;
+    memcpy(data_port_read, &rx_fifo.buf[rx_fifo.pos], n);
+    rx_fifo.pos += n;
+    *len_read = n;
+
+    count_copies = counting;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static void
+tx_sink_feed(
+    const uint8_t *data,
+    size_t len)
+{
+    while (len > 0)
+    {
+        size_t consumed = 0;
+        chanmux_nic_rx_parser_event_t event = chanmux_nic_rx_parser_feed(
+                                                  &tx_sink.parser,
+                                                  data,
+                                                  len,
+                                                  &consumed);
+        data += consumed;
+        len -= consumed;
+        if (CHANMUX_NIC_RX_PARSER_NEED_BUFFER == event)
+        {
+            chanmux_nic_rx_parser_set_buffer(&tx_sink.parser, tx_sink.frame);
+        }
+        else if ((CHANMUX_NIC_RX_PARSER_FRAME == event) && tx_sink.tcp)
+        {
+            tx_sink_check_tcp(tx_sink.frame,
+                              chanmux_nic_rx_parser_get_frame_len(&tx_sink.parser));
+            tx_sink.frames++;
+        }
+        else if (CHANMUX_NIC_RX_PARSER_FRAME == event)
+        {
+            size_t frame_len = chanmux_nic_rx_parser_get_frame_len(&tx_sink.parser);
+            const uint8_t *frame = tx_sink.frame;
+            uint32_t seq = ((uint32_t)frame[0] << 24) | ((uint32_t)frame[1] << 16) |
+                           ((uint32_t)frame[2] << 8) | frame[3];
+            int cls = (frame_len <= BENCH_TX_SMALL_LEN) ? 0 : 1;
+            if ((frame[frame_len - 1] != (seq & 0xFF)) ||
+                (seq < tx_sink.next_seq[cls]))
+            {
+                tx_sink.bad++;
+            }
+            if (tx_sink.csum)
+            {
+                double check_start = now_sec();
+                tx_sink.bad += frame_check_csum(frame, frame_len) ? 0 : 1;
+                tx_sink.csum_sec += now_sec() - check_start;
+            }
+            tx_sink.next_seq[cls] = seq + 1;
+            double delay = now_sec() - tx_sink.sent[seq % BENCH_TX_TRACE];
+            tx_sink.delay_sum[cls] += delay;
+            tx_sink.delay_cnt[cls]++;
+            if (delay > tx_sink.delay_max[cls])
+            {
+                tx_sink.delay_max[cls] = delay;
+            }
+            tx_sink.frames++;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// a congested ChanMux takes only a part of the data
+static OS_Error_t
+data_write(
+    unsigned int id,
+    size_t len,
+    size_t *len_written)
+{
+    (void)id;
+
+    bool counting = count_copies;
+    count_copies = false;
+
+    cnt.writes++;
+    size_t n = ((0 != tx_sink.chunk) && (len > tx_sink.chunk)) ? tx_sink.chunk : len;
+    cnt.tx_bytes += n;
+    tx_sink_feed(data_port_write, n);
+    *len_written = n;
+
+    count_copies = counting;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// the RX loop never returns, so we leave it once all data has been consumed
+static void
+data_wait(void)
+{
+    cnt.waits++;
+    if (rx_fifo.pos >= rx_fifo.len)
+    {
+        longjmp(rx_done, 1);
+    }
+}
+
+//------------------------------------------------------------------------------
+// wait and read in a single call
+static OS_Error_t
+data_read_blocking(
+    unsigned int id,
+    size_t len,
+    size_t *len_read)
+{
+    if (rx_fifo.pos >= rx_fifo.len)
+    {
+        longjmp(rx_done, 1);
+    }
+    return data_read(id, len, len_read);
+}
+
+//------------------------------------------------------------------------------
+// every command gets a success response, GET_MAC also returns a MAC and
+// GET_CAPS the link capabilities. Responses are queued in order, so several
+// commands can be in flight.
+static OS_Error_t
+ctrl_write(
+    unsigned int id,
+    size_t len,
+    size_t *len_written)
+{
+    (void)id;
+
+    // version 1, any number of frames per write, max frame len 0xFFFF, the
+    // features of the scenario and no offloads
+    const uint8_t caps[CHANMUX_NIC_GET_CAPS_RSP_LEN - 2] =
+    {
+        1, 0, 0xFF, 0xFF, (peer_features >> 8) & 0xFF, peer_features & 0xFF, 0, 0
+    };
+
+    uint8_t *rsp = &ctrl_fifo.rsp[ctrl_fifo.len];
+    size_t rsp_len = 2;
+    rsp[0] = ctrl_port_write[0];
+    rsp[1] = 0;
+    if (CHANMUX_NIC_CMD_GET_MAC == ctrl_port_write[0])
+    {
+        memcpy(&rsp[2], bench_mac, MAC_SIZE);
+        rsp_len += MAC_SIZE;
+    }
+    else if (CHANMUX_NIC_CMD_GET_CAPS == ctrl_port_write[0])
+    {
+        memcpy(&rsp[2], caps, sizeof(caps));
+        rsp_len += sizeof(caps);
+    }
+    ctrl_fifo.len += rsp_len;
+
+    *len_written = len;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+ctrl_read(
+    unsigned int id,
+    size_t len,
+    size_t *len_read)
+{
+    (void)id;
+
+    size_t n = (ctrl_fifo.len > len) ? len : ctrl_fifo.len;
+    memcpy(ctrl_port_read, ctrl_fifo.rsp, n);
+    memmove(ctrl_fifo.rsp, &ctrl_fifo.rsp[n], ctrl_fifo.len - n);
+    ctrl_fifo.len -= n;
+    *len_read = n;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static void
+ctrl_wait(void)
+{
+}
+
+//------------------------------------------------------------------------------
+static int
+mutex_nop(void)
+{
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// scenarios
+//------------------------------------------------------------------------------
+typedef struct
+{
+    const char *name;
+    const size_t *sizes;
+    size_t num_sizes;
+} frame_mix_t;
+
+static const size_t mix_small[] = { 60 };
+static const size_t mix_large[] = { 1514 };
+// 9000 byte MTU, the frames span several ring slots
+static const size_t mix_jumbo[] = { 9014 };
+// simple IMIX, 7:4:1 ratio of small, medium and large frames
+static const size_t mix_imix[] = { 60, 60, 60, 60, 60, 60, 60,
+                                   590, 590, 590, 590, 1514
+                                 };
+
+static const frame_mix_t frame_mixes[] =
+{
+    { "small", mix_small, sizeof(mix_small) / sizeof(mix_small[0]) },
+    { "large", mix_large, sizeof(mix_large) / sizeof(mix_large[0]) },
+    { "jumbo", mix_jumbo, sizeof(mix_jumbo) / sizeof(mix_jumbo[0]) },
+    { "imix",  mix_imix,  sizeof(mix_imix) / sizeof(mix_imix[0]) },
+};
+
+typedef struct
+{
+    const frame_mix_t *mix;
+    size_t frames;
+    size_t chunk;
+    bool rx_zero_copy;
+    unsigned int rx_batch;
+    size_t rx_poll;
+    bool rx_read_blocking;
+    bool tx_zero_copy;
+    bool tx_headroom; // TX zero-copy configured, but with a separate port
+    unsigned int tx_aggregate;
+    size_t tx_queue;   // TX queue size in bytes, 0 disables it
+    unsigned int tx_classes; // TX priority classes
+    size_t tx_write;   // max bytes a ChanMux write takes, 0 is all
+    bool latency;
+    bool framing_v2;
+    size_t corrupt; // corrupt every n-th RX frame, framing v2 only
+    unsigned int rx_clients; // RX clients, frames are steered by flow hash
+    size_t rx_foreign; // every n-th RX frame is for another host, RX filter on
+    bool csum; // checksum offload, RX and TX frames are IPv4/UDP
+    size_t lro; // LRO, RX frames are TCP segments in bursts of n per flow
+    size_t tso; // TSO, TX frames are sent as TCP segments of n frames
+} scenario_t;
+
+//------------------------------------------------------------------------------
+// IPv4/UDP frame of a flow, with the sequence number in the flow behind the
+// UDP header
+static void
+rx_frame_set_flow(
+    uint8_t *frame,
+    size_t len,
+    size_t i)
+{
+    unsigned int flow = i % BENCH_RX_FLOWS;
+    uint32_t seq = i / BENCH_RX_FLOWS;
+    static const uint8_t eth_ip[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+        0x08, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11,
+        0x00, 0x00, 10, 0, 0, 0, 10, 0, 1, 1
+    };
+
+    memcpy(frame, eth_ip, sizeof(eth_ip));
+    frame[16] = ((len - 14) >> 8) & 0xFF;
+    frame[17] = (len - 14) & 0xFF;
+    frame[29] = flow + 1;
+    // UDP ports
+    frame[34] = 0x04;
+    frame[35] = flow;
+    frame[36] = 0x13;
+    frame[37] = 0x88;
+    // UDP length, the checksum is left blank
+    frame[38] = ((len - 34) >> 8) & 0xFF;
+    frame[39] = (len - 34) & 0xFF;
+    frame[40] = 0;
+    frame[41] = 0;
+    frame[BENCH_RX_FLOW_SEQ_OFS] = (seq >> 24) & 0xFF;
+    frame[BENCH_RX_FLOW_SEQ_OFS + 1] = (seq >> 16) & 0xFF;
+    frame[BENCH_RX_FLOW_SEQ_OFS + 2] = (seq >> 8) & 0xFF;
+    frame[BENCH_RX_FLOW_SEQ_OFS + 3] = seq & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+// One's complement sum of big endian 16-bit words, an implementation of the
+// benchmark's own to check the driver against.
+static uint16_t
+frame_csum(
+    const uint8_t *data,
+    size_t len,
+    uint32_t sum)
+{
+    for (size_t i = 0; i + 1 < len; i += 2)
+    {
+        sum += ((uint32_t)data[i] << 8) | data[i + 1];
+    }
+    if (len & 1)
+    {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+//------------------------------------------------------------------------------
+// UDP checksum including the pseudo header of a frame from
+// rx_frame_set_flow()
+static uint16_t
+frame_udp_csum(
+    const uint8_t *frame,
+    size_t len)
+{
+    size_t udp_len = len - 34;
+    uint32_t sum = frame_csum(&frame[26], 8, 0) + 17 + udp_len;
+    return frame_csum(&frame[34], udp_len, sum);
+}
+
+//------------------------------------------------------------------------------
+static void
+frame_set_ip_csum(
+    uint8_t *frame)
+{
+    frame[24] = 0;
+    frame[25] = 0;
+    uint16_t csum = ~frame_csum(&frame[14], 20, 0);
+    frame[24] = (csum >> 8) & 0xFF;
+    frame[25] = csum & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+// fill in the IPv4 header and UDP checksum of a frame from rx_frame_set_flow()
+static void
+frame_set_csum(
+    uint8_t *frame,
+    size_t len)
+{
+    uint16_t csum = ~frame_csum(&frame[14], 20, 0);
+    frame[24] = (csum >> 8) & 0xFF;
+    frame[25] = csum & 0xFF;
+    csum = ~frame_udp_csum(frame, len);
+    csum = (0 == csum) ? 0xFFFF : csum;
+    frame[40] = (csum >> 8) & 0xFF;
+    frame[41] = csum & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+// TCP checksum including the pseudo header of a frame from rx_frame_set_tcp()
+static uint16_t
+frame_tcp_csum(
+    const uint8_t *frame,
+    size_t len)
+{
+    size_t tcp_len = len - 34;
+    uint32_t sum = frame_csum(&frame[26], 8, 0) + 6 + tcp_len;
+    return frame_csum(&frame[34], tcp_len, sum);
+}
+
+//------------------------------------------------------------------------------
+// payload byte at a position in the data of a TCP flow
+static uint8_t
+rx_tcp_byte(
+    unsigned int flow,
+    uint32_t pos)
+{
+    return (uint8_t)((pos * 7) + (pos >> 8) + flow);
+}
+
+//------------------------------------------------------------------------------
+// IPv4/TCP segment of a flow, seq is the position of its data in the flow
+static void
+rx_frame_set_tcp(
+    uint8_t *frame,
+    size_t len,
+    unsigned int flow,
+    uint32_t seq,
+    bool push)
+{
+    rx_frame_set_flow(frame, len, flow);
+    frame[23] = 6;
+    // sequence and ACK number, header length, ACK and maybe PSH, window and
+    // urgent pointer
+    const uint8_t tcp[] =
+    {
+        (seq >> 24) & 0xFF, (seq >> 16) & 0xFF, (seq >> 8) & 0xFF, seq & 0xFF,
+        0x00, 0x00, 0x10, 0x00, 0x50, push ? 0x18 : 0x10, 0xFF, 0xFF,
+        0x00, 0x00, 0x00, 0x00
+    };
+    memcpy(&frame[38], tcp, sizeof(tcp));
+    for (size_t i = BENCH_RX_TCP_HDR_LEN; i < len; i++)
+    {
+        frame[i] = rx_tcp_byte(flow, seq + i - BENCH_RX_TCP_HDR_LEN);
+    }
+
+    uint16_t csum = ~frame_csum(&frame[14], 20, 0);
+    frame[24] = (csum >> 8) & 0xFF;
+    frame[25] = csum & 0xFF;
+    csum = ~frame_tcp_csum(frame, len);
+    frame[50] = (csum >> 8) & 0xFF;
+    frame[51] = csum & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+static bool
+frame_check_tcp(
+    const uint8_t *frame,
+    size_t len)
+{
+    return (0xFFFF == frame_csum(&frame[14], 20, 0)) &&
+           (0xFFFF == frame_tcp_csum(frame, len));
+}
+
+//------------------------------------------------------------------------------
+// check a TCP frame the peer got from TSO. Its checksums must be correct, the
+// IP ID must count up and the data must continue the flow of its class.
+static void
+tx_sink_check_tcp(
+    const uint8_t *frame,
+    size_t len)
+{
+    double check_start = now_sec();
+    unsigned int flow = frame[29] - 1;
+    uint32_t seq = ((uint32_t)frame[38] << 24) | ((uint32_t)frame[39] << 16) |
+                   ((uint32_t)frame[40] << 8) | frame[41];
+    size_t ip_len = ((size_t)frame[16] << 8) | frame[17];
+    uint16_t ip_id = ((uint16_t)frame[18] << 8) | frame[19];
+
+    bool ok = (flow < 2) && (ip_len + 14 == len) && frame_check_tcp(frame, len) &&
+              (seq == tx_sink.next_seq[flow]) &&
+              (ip_id == tx_sink.next_ip_id[flow]);
+    for (size_t i = BENCH_RX_TCP_HDR_LEN; ok && (i < len); i++)
+    {
+        ok = (frame[i] == rx_tcp_byte(flow, seq + i - BENCH_RX_TCP_HDR_LEN));
+    }
+    if (!ok)
+    {
+        tx_sink.bad++;
+    }
+    else
+    {
+        tx_sink.next_seq[flow] = seq + (len - BENCH_RX_TCP_HDR_LEN);
+        tx_sink.next_ip_id[flow] = ip_id + 1;
+    }
+    tx_sink.csum_sec += now_sec() - check_start;
+}
+
+//------------------------------------------------------------------------------
+static bool
+frame_check_csum(
+    const uint8_t *frame,
+    size_t len)
+{
+    return (0xFFFF == frame_csum(&frame[14], 20, 0)) &&
+           (0xFFFF == frame_udp_csum(frame, len));
+}
+
+//------------------------------------------------------------------------------
+// Set the destination MAC for the RX filter. Every n-th frame is for another
+// host, alternately unicast and a multicast group nobody has joined. Returns
+// true for these frames.
+static bool
+rx_frame_set_dst(
+    uint8_t *frame,
+    size_t i,
+    size_t foreign)
+{
+    if (0 == ((i + 1) % foreign))
+    {
+        memcpy(frame, ((i / foreign) % 2) ? bench_mcast_other : bench_mac,
+               MAC_SIZE);
+        frame[MAC_SIZE - 1] ^= ((i / foreign) % 2) ? 0 : 0x01;
+        return true;
+    }
+
+    memcpy(frame, (0 == (i % 8)) ? bench_mcast_joined : bench_mac, MAC_SIZE);
+    return false;
+}
+
+//------------------------------------------------------------------------------
+static double
+now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+//------------------------------------------------------------------------------
+static uint64_t
+get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// print the latency histograms as mean, the upper bucket bound of the 50th
+// and 99th percentile and the max.
+static void
+report_latency(void)
+{
+    static const char *stage_names[CHANMUX_NIC_DRV_LATENCY_STAGES] =
+    {
+        "rx data wait", "rx read", "rx parse", "rx slot wait", "rx stack", "tx"
+    };
+
+    chanmux_nic_drv_stats_t stats;
+    if (chanmux_nic_driver_rpc_get_stats(&stats) != OS_SUCCESS)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_LATENCY_STAGES; i++)
+    {
+        const chanmux_nic_drv_latency_hist_t *hist = &stats.latency[i];
+        uint64_t p50_ns = 0;
+        uint64_t p99_ns = 0;
+        uint64_t sum = 0;
+        for (unsigned int b = 0; b < CHANMUX_NIC_DRV_LATENCY_BUCKETS; b++)
+        {
+            sum += hist->bucket[b];
+            uint64_t limit_ns = 128ULL << b;
+            if ((0 == p50_ns) && (sum * 2 >= hist->count))
+            {
+                p50_ns = limit_ns;
+            }
+            if ((0 == p99_ns) && (sum * 100 >= hist->count * 99))
+            {
+                p99_ns = limit_ns;
+            }
+        }
+        printf("   %-12s %10llu samples %10.0f ns mean  p50 < %8llu ns  "
+               "p99 < %8llu ns  max %10llu ns\n",
+               stage_names[i], (unsigned long long)hist->count,
+               hist->count ? (double)hist->sum_ns / hist->count : 0.0,
+               (unsigned long long)p50_ns, (unsigned long long)p99_ns,
+               (unsigned long long)hist->max_ns);
+    }
+}
+
+//------------------------------------------------------------------------------
+static void
+report(
+    const char *dir,
+    const scenario_t *sc,
+    size_t frames,
+    size_t bytes,
+    size_t rpcs,
+    double sec)
+{
+    printf("%-2s %-5s chunk=%-5zu zc=%d/%d batch=%-2u poll=%-5zu aggr=%-2u v%d | "
+           "%10.0f frames/s %8.2f MB/s %6.2f rpc/frame %8.1f copied/frame "
+           "%6.2f notify/frame %zu yields\n",
+           dir, sc->mix->name, sc->chunk, sc->rx_zero_copy, sc->tx_zero_copy,
+           sc->rx_batch, sc->rx_poll, sc->tx_aggregate, sc->framing_v2 ? 2 : 1,
+           frames / sec, bytes / sec / 1e6,
+           frames ? (double)rpcs / frames : 0.0,
+           frames ? (double)cnt.bytes_copied / frames : 0.0,
+           frames ? (double)cnt.notifies / frames : 0.0,
+           cnt.yields);
+}
+
+//------------------------------------------------------------------------------
+static int
+run_scenario(
+    const scenario_t *sc)
+{
+    static chanmux_nic_drv_config_t cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.chanmux.ctrl.id = 4;
+    cfg.chanmux.ctrl.port.read = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                     ctrl_port_read_buf, sizeof(ctrl_port_read));
+    cfg.chanmux.ctrl.port.write = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                      ctrl_port_write_buf, sizeof(ctrl_port_write));
+    cfg.chanmux.ctrl.func.read = ctrl_read;
+    cfg.chanmux.ctrl.func.write = ctrl_write;
+    cfg.chanmux.ctrl.wait = ctrl_wait;
+    cfg.chanmux.data.id = 5;
+    cfg.chanmux.data.port.read = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                     data_port_read_buf, sizeof(data_port_read));
+    cfg.chanmux.data.port.write = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                      data_port_write_buf, BENCH_PORT_SIZE);
+    cfg.chanmux.data.func.read = data_read;
+    cfg.chanmux.data.func.write = data_write;
+    cfg.chanmux.data.wait = data_wait;
+    if (sc->rx_read_blocking)
+    {
+        cfg.chanmux.data_read_blocking = data_read_blocking;
+    }
+    cfg.network_stack.to = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                               stack_port_to_buf[0], sizeof(stack_port_to[0]));
+    cfg.network_stack.from = sc->tx_zero_copy
+                             ? (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                 data_port_write_buf, sizeof(data_port_write))
+                             : (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                 stack_port_from_buf, sizeof(stack_port_from));
+    cfg.network_stack.notify = stack_notify;
+    cfg.nic_control_channel_mutex.lock = mutex_nop;
+    cfg.nic_control_channel_mutex.unlock = mutex_nop;
+    cfg.rx.zero_copy = sc->rx_zero_copy;
+    cfg.rx.batch_max_frames = sc->rx_batch;
+    cfg.rx.ring_elements = BENCH_RING_ELEMENTS;
+    cfg.rx.chain_slots = true;
+    cfg.rx.poll_budget = sc->rx_poll;
+    cfg.rx.filter = (0 != sc->rx_foreign);
+    cfg.rx.csum_offload = sc->csum;
+    cfg.rx.lro.max_len = (0 != sc->lro) ? 0xFFFF : 0;
+    cfg.rx.lro.timeout_ns = 100000;
+    static const event_notify_func_t client_notify[] =
+    {
+        stack_notify_1, stack_notify_2, stack_notify_3
+    };
+    cfg.rx.steering.clients = sc->rx_clients;
+    cfg.rx.steering.hash = true;
+    for (unsigned int i = 1; i < sc->rx_clients; i++)
+    {
+        cfg.rx.steering.client[i - 1].to = (OS_Dataport_t) OS_DATAPORT_ASSIGN_SIZE(
+                                               stack_port_to_buf[i],
+                                               sizeof(stack_port_to[i]));
+        cfg.rx.steering.client[i - 1].notify = client_notify[i - 1];
+    }
+    cfg.tx.zero_copy = sc->tx_zero_copy || sc->tx_headroom;
+    cfg.tx.aggregate_max_frames = sc->tx_aggregate;
+    cfg.tx.csum_offload = sc->csum;
+    cfg.tx.queue.buffer = (0 != sc->tx_queue) ? tx_queue : NULL;
+    cfg.tx.queue.size = sc->tx_queue;
+    cfg.tx.queue.classes = sc->tx_classes;
+    // small frames and ARP/ICMP first, all others in the last class
+    cfg.tx.queue.small_len = BENCH_TX_SMALL_LEN;
+    cfg.tx.queue.default_class = (sc->tx_classes > 1) ? sc->tx_classes - 1 : 0;
+    cfg.ctrl.get_caps = true;
+    if (sc->latency)
+    {
+        cfg.clock.get_time_ns = get_time_ns;
+        cfg.stats.latency = true;
+    }
+
+    peer_features = sc->framing_v2 ? CHANMUX_NIC_FEATURE_RX_FRAMING_V2 : 0;
+
+    if (chanmux_nic_driver_init(&cfg) != OS_SUCCESS)
+    {
+        printf("chanmux_nic_driver_init() failed\n");
+        return -1;
+    }
+    if (0 != sc->rx_foreign)
+    {
+        // a group that does not share the hash bit of the joined one
+        while (chanmux_nic_driver_mcast_hash(bench_mcast_other) ==
+               chanmux_nic_driver_mcast_hash(bench_mcast_joined))
+        {
+            bench_mcast_other[MAC_SIZE - 1]++;
+        }
+        chanmux_nic_driver_rpc_set_rx_filter(
+            0, chanmux_nic_driver_mcast_hash(bench_mcast_joined));
+    }
+    // the driver starts with the first ring slot again
+    memset(stack_pos, 0, sizeof(stack_pos));
+    rx_flows.clients = sc->rx_clients;
+    rx_flows.tcp = (0 != sc->lro);
+    rx_flows.check_sec = 0;
+    memset(rx_flows.client, -1, sizeof(rx_flows.client));
+    memset(rx_flows.next_seq, 0, sizeof(rx_flows.next_seq));
+    uint32_t tcp_seq[BENCH_RX_FLOWS] = { 0 };
+
+    // RX, fill the FIFO with length prefixed frames and let the driver
+    // deliver them into the ring.
+    rx_fifo.len = 0;
+    rx_fifo.pos = 0;
+    rx_fifo.chunk = sc->chunk;
+    size_t frames = 0;
+    size_t corrupted = 0;
+    size_t foreign = 0;
+    for (size_t i = 0; i < sc->frames; i++)
+    {
+        size_t len = sc->mix->sizes[i % sc->mix->num_sizes];
+        if (rx_fifo.len + CHANMUX_NIC_RX_PARSER_V2_HDR_LEN + len +
+            CHANMUX_NIC_RX_PARSER_V2_CRC_LEN > sizeof(rx_fifo.buf))
+        {
+            break;
+        }
+        uint8_t *frame = &rx_fifo.buf[rx_fifo.len];
+        if (sc->framing_v2)
+        {
+            rx_fifo.buf[rx_fifo.len++] = CHANMUX_NIC_RX_PARSER_V2_SYNC_0;
+            rx_fifo.buf[rx_fifo.len++] = CHANMUX_NIC_RX_PARSER_V2_SYNC_1;
+            rx_fifo.buf[rx_fifo.len++] = (i >> 8) & 0xFF;
+            rx_fifo.buf[rx_fifo.len++] = i & 0xFF;
+        }
+        rx_fifo.buf[rx_fifo.len++] = (len >> 8) & 0xFF;
+        rx_fifo.buf[rx_fifo.len++] = len & 0xFF;
+        if (sc->framing_v2)
+        {
+            rx_fifo.buf[rx_fifo.len++] = ~(len >> 8) & 0xFF;
+            rx_fifo.buf[rx_fifo.len++] = ~len & 0xFF;
+        }
+        memset(&rx_fifo.buf[rx_fifo.len], (int)i, len);
+        if (0 != sc->lro)
+        {
+            // PSH ends a burst of a flow
+            unsigned int flow = (i / sc->lro) % BENCH_RX_FLOWS;
+            rx_frame_set_tcp(&rx_fifo.buf[rx_fifo.len], len, flow, tcp_seq[flow],
+                             (0 == ((i + 1) % sc->lro)));
+            tcp_seq[flow] += len - BENCH_RX_TCP_HDR_LEN;
+        }
+        else if ((sc->rx_clients > 1) || sc->csum)
+        {
+            rx_frame_set_flow(&rx_fifo.buf[rx_fifo.len], len, i);
+        }
+        if (sc->csum && (0 == sc->lro))
+        {
+            frame_set_csum(&rx_fifo.buf[rx_fifo.len], len);
+        }
+        bool is_foreign = (0 != sc->rx_foreign) &&
+                          rx_frame_set_dst(&rx_fifo.buf[rx_fifo.len], i,
+                                           sc->rx_foreign);
+        if (sc->framing_v2)
+        {
+            uint32_t crc = chanmux_nic_crc32_final(chanmux_nic_crc32_update(
+                                                       CHANMUX_NIC_CRC32_INIT,
+                                                       &rx_fifo.buf[rx_fifo.len],
+                                                       len));
+            rx_fifo.buf[rx_fifo.len + len] = (crc >> 24) & 0xFF;
+            rx_fifo.buf[rx_fifo.len + len + 1] = (crc >> 16) & 0xFF;
+            rx_fifo.buf[rx_fifo.len + len + 2] = (crc >> 8) & 0xFF;
+            rx_fifo.buf[rx_fifo.len + len + 3] = crc & 0xFF;
+            rx_fifo.len += CHANMUX_NIC_RX_PARSER_V2_CRC_LEN;
+
+            // alternately break the data and the sync marker, the driver
+            // must lose just this frame. The loss shows in the sequence
+            // numbers of the next frame, so the last frame is kept intact.
+            if ((0 != sc->corrupt) && (0 == ((i + 1) % sc->corrupt)) &&
+                (i + 1 < sc->frames))
+            {
+                size_t pos = ((i / sc->corrupt) % 2) ? 0 : 10;
+                frame[pos] ^= 0x01;
+                corrupted++;
+                is_foreign = false;
+            }
+        }
+        foreign += is_foreign ? 1 : 0;
+        rx_fifo.len += len;
+        frames++;
+    }
+
+    memset(&cnt, 0, sizeof(cnt));
+    double start = now_sec();
+    if (0 == setjmp(rx_done))
+    {
+        count_copies = true;
+        chanmux_nic_driver_run();
+        count_copies = false;
+        printf("chanmux_nic_driver_run() returned unexpectedly\n");
+        return -1;
+    }
+    count_copies = false;
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_RX_CLIENTS_MAX; i++)
+    {
+        stack_consume(i);
+    }
+    double sec = now_sec() - start - rx_flows.check_sec;
+    chanmux_nic_drv_stats_t stats;
+    chanmux_nic_driver_rpc_get_stats(&stats);
+    // with checksum offload, every frame must be verified. With LRO, the
+    // segments merged into others do not arrive as frames of their own.
+    size_t csum_ok = sc->csum ? cnt.rx_frames : 0;
+    if ((cnt.rx_frames + stats.rx_lro_merged != frames - corrupted - foreign) ||
+        (stats.rx_lost_frames != corrupted) ||
+        (stats.rx_filtered != foreign) || (0 != cnt.rx_bad) ||
+        (cnt.rx_csum_ok != csum_ok) || (stats.rx_csum_ok != csum_ok) ||
+        (0 != stats.rx_lro_dropped))
+    {
+        printf("RX: got %zu of %zu frames, %llu merged, %zu corrupted, "
+               "%llu lost, %llu of %zu foreign filtered, %zu out of flow "
+               "order, %zu checksums verified\n",
+               cnt.rx_frames, frames, (unsigned long long)stats.rx_lro_merged,
+               corrupted, (unsigned long long)stats.rx_lost_frames,
+               (unsigned long long)stats.rx_filtered, foreign, cnt.rx_bad,
+               cnt.rx_csum_ok);
+        return -1;
+    }
+    // without lost frames, all data of every flow must have arrived
+    for (unsigned int i = 0; (0 != sc->lro) && (0 == corrupted + foreign) &&
+         (i < BENCH_RX_FLOWS); i++)
+    {
+        if (rx_flows.next_seq[i] != tcp_seq[i])
+        {
+            printf("RX: TCP flow %u got %u of %u bytes\n", i,
+                   rx_flows.next_seq[i], tcp_seq[i]);
+            return -1;
+        }
+    }
+    // waiting for the ChanMUX event is a call into the kernel also
+    report("RX", sc, cnt.rx_frames, cnt.rx_bytes, cnt.reads + cnt.waits, sec);
+    if (sc->rx_clients > 1)
+    {
+        printf("   RX frames per client:");
+        for (unsigned int i = 0; i < sc->rx_clients; i++)
+        {
+            printf(" %llu", (unsigned long long)stats.rx_client_frames[i]);
+        }
+        printf("\n");
+    }
+    if (0 != sc->rx_foreign)
+    {
+        printf("   RX filtered %llu frames\n",
+               (unsigned long long)stats.rx_filtered);
+    }
+    if (0 != sc->lro)
+    {
+        printf("   LRO merged %llu segments, %zu frames of %.0f bytes on "
+               "average\n", (unsigned long long)stats.rx_lro_merged,
+               cnt.rx_frames, cnt.rx_frames ? (double)cnt.rx_bytes / cnt.rx_frames : 0.0);
+    }
+
+    // TX, the network stack sends the same frame mix. Frames that do not fit
+    // into the network stack output port are missing at the peer.
+    // With the TX zero-copy option, the frame starts behind the headroom even
+    // if the driver has to copy it.
+    uint8_t *tx_frame = sc->tx_zero_copy
+                        ? &data_port_write[CHANMUX_NIC_DRV_TX_HEADROOM]
+                        : sc->tx_headroom
+                        ? &stack_port_from[CHANMUX_NIC_DRV_TX_HEADROOM]
+                        : &stack_port_from[0];
+    size_t tx_frame_max = sc->tx_zero_copy
+                          ? sizeof(data_port_write) - CHANMUX_NIC_DRV_TX_HEADROOM
+                          : sc->tx_headroom
+                          ? sizeof(stack_port_from) - CHANMUX_NIC_DRV_TX_HEADROOM
+                          : sizeof(stack_port_from);
+    size_t tx_frames = 0;
+    size_t tx_dropped = 0;
+    size_t tx_skipped = 0;
+    uint32_t tx_tcp_seq[2] = { 0, 0 };
+    uint16_t tx_ip_id[2] = { 0, 0 };
+    chanmux_nic_rx_parser_init(&tx_sink.parser, sizeof(tx_sink.frame),
+                               CHANMUX_NIC_RX_PARSER_FRAMING_V1);
+    tx_sink.chunk = sc->tx_write;
+    tx_sink.csum = sc->csum;
+    tx_sink.tcp = (0 != sc->tso);
+    tx_sink.csum_sec = 0;
+    tx_sink.frames = 0;
+    tx_sink.bad = 0;
+    memset(tx_sink.next_seq, 0, sizeof(tx_sink.next_seq));
+    memset(tx_sink.next_ip_id, 0, sizeof(tx_sink.next_ip_id));
+    memset(tx_sink.delay_sum, 0, sizeof(tx_sink.delay_sum));
+    memset(tx_sink.delay_max, 0, sizeof(tx_sink.delay_max));
+    memset(tx_sink.delay_cnt, 0, sizeof(tx_sink.delay_cnt));
+    memset(&cnt, 0, sizeof(cnt));
+    start = now_sec();
+    for (size_t i = 0; i < frames; i++)
+    {
+        size_t len = sc->mix->sizes[i % sc->mix->num_sizes];
+        if (len > tx_frame_max)
+        {
+            tx_skipped++;
+            continue;
+        }
+        size_t segs = 1;
+        size_t mss = 0;
+        if (0 != sc->tso)
+        {
+            // one TCP segment with the data of the next frames of the same
+            // size, as far as they fit into an IP packet
+            double build_start = now_sec();
+            unsigned int flow = (len <= BENCH_TX_SMALL_LEN) ? 0 : 1;
+            size_t max_len = (tx_frame_max < 14 + 0xFFFF) ? tx_frame_max : 14 + 0xFFFF;
+            mss = len - BENCH_RX_TCP_HDR_LEN;
+            while ((segs < sc->tso) && (i + segs < frames) &&
+                   (sc->mix->sizes[(i + segs) % sc->mix->num_sizes] == len) &&
+                   (BENCH_RX_TCP_HDR_LEN + (segs + 1) * mss <= max_len))
+            {
+                segs++;
+            }
+            len = BENCH_RX_TCP_HDR_LEN + segs * mss;
+            rx_frame_set_tcp(tx_frame, len, flow, tx_tcp_seq[flow], true);
+            tx_frame[18] = (tx_ip_id[flow] >> 8) & 0xFF;
+            tx_frame[19] = tx_ip_id[flow] & 0xFF;
+            frame_set_ip_csum(tx_frame);
+            tx_tcp_seq[flow] += segs * mss;
+            tx_ip_id[flow] += segs;
+            i += segs - 1;
+            tx_sink.csum_sec += now_sec() - build_start;
+        }
+        else
+        {
+            uint32_t seq = tx_frames - tx_dropped;
+            memset(tx_frame, (int)(seq & 0xFF), len);
+            if (sc->csum)
+            {
+                // the driver fills in the checksums
+                rx_frame_set_flow(tx_frame, len, seq);
+                tx_frame[3] = seq & 0xFF;
+            }
+            tx_frame[0] = (seq >> 24) & 0xFF;
+            tx_frame[1] = (seq >> 16) & 0xFF;
+            tx_frame[2] = (seq >> 8) & 0xFF;
+            tx_sink.sent[seq % BENCH_TX_TRACE] = now_sec();
+        }
+        tx_frames += segs;
+        size_t len_sent = len;
+        count_copies = true;
+        OS_Error_t err;
+        while (OS_ERROR_TRY_AGAIN == (err = (0 != sc->tso)
+                                            ? chanmux_nic_driver_rpc_tx_data_tso(&len_sent, mss)
+                                            : chanmux_nic_driver_rpc_tx_data(&len_sent)))
+        {
+            // the TX queue is full, hold the frame back until it has drained
+            while (OS_ERROR_TRY_AGAIN == chanmux_nic_driver_rpc_tx_poll())
+            {
+            }
+            len_sent = len;
+        }
+        count_copies = false;
+        if ((err != OS_SUCCESS) || (len_sent != len))
+        {
+            // without a TX queue, a partial write drops the frame
+            if (0 == sc->tx_write)
+            {
+                printf("TX: chanmux_nic_driver_rpc_tx_data() failed, error %d\n",
+                       err);
+                return -1;
+            }
+            tx_dropped += segs;
+        }
+    }
+    count_copies = true;
+    while (OS_ERROR_TRY_AGAIN == chanmux_nic_driver_rpc_tx_flush())
+    {
+    }
+    count_copies = false;
+    sec = now_sec() - start - tx_sink.csum_sec;
+    report("TX", sc, tx_frames, cnt.tx_bytes, cnt.writes, sec);
+    chanmux_nic_driver_rpc_get_stats(&stats);
+    if (sc->csum)
+    {
+        printf("   checksums verified in %llu RX frames, filled in %llu TX "
+               "frames\n", (unsigned long long)stats.rx_csum_ok,
+               (unsigned long long)stats.tx_csum_filled);
+    }
+    if (0 != sc->tso)
+    {
+        printf("   TSO split %llu segments, %.2f ChanMux writes per segment\n",
+               (unsigned long long)stats.tx_tso_frames,
+               stats.tx_tso_frames ? (double)cnt.writes / stats.tx_tso_frames : 0.0);
+    }
+    if (0 != sc->tx_queue)
+    {
+        printf("   TX queue peak %llu bytes, %llu stops, %llu partial writes\n",
+               (unsigned long long)stats.tx_queue_peak,
+               (unsigned long long)stats.tx_queue_stops,
+               (unsigned long long)stats.tx_partial_writes);
+        for (int i = 0; i < 2; i++)
+        {
+            if (0 != tx_sink.delay_cnt[i])
+            {
+                printf("   TX %s frames: %zu, delay mean %.1f us, max %.1f us\n",
+                       (0 == i) ? "small" : "other", tx_sink.delay_cnt[i],
+                       tx_sink.delay_sum[i] / tx_sink.delay_cnt[i] * 1e6,
+                       tx_sink.delay_max[i] * 1e6);
+            }
+        }
+    }
+    if (0 != tx_skipped)
+    {
+        printf("TX: peer got none of %zu frames too big for the network "
+               "stack output\n", tx_skipped);
+        return -1;
+    }
+    if ((tx_sink.frames != tx_frames - tx_dropped) || (0 != tx_sink.bad))
+    {
+        printf("TX: peer got %zu of %zu frames, %zu dropped, %zu corrupted\n",
+               tx_sink.frames, tx_frames, tx_dropped, tx_sink.bad);
+        // expected for partial writes without a TX queue
+        if ((0 == sc->tx_write) || (0 != sc->tx_queue))
+        {
+            return -1;
+        }
+    }
+    if (sc->latency)
+    {
+        report_latency();
+    }
+
+    // parser only, feed the RX data in chunks without ChanMux and ring
+    static uint8_t frame_buf[0xFFFF];
+    chanmux_nic_rx_parser_t parser;
+    chanmux_nic_rx_parser_init(&parser, sizeof(frame_buf),
+                               sc->framing_v2 ? CHANMUX_NIC_RX_PARSER_FRAMING_V2
+                               : CHANMUX_NIC_RX_PARSER_FRAMING_V1);
+    memset(&cnt, 0, sizeof(cnt));
+    start = now_sec();
+    count_copies = true;
+    for (size_t pos = 0; pos < rx_fifo.len; )
+    {
+        size_t len = rx_fifo.len - pos;
+        len = (len > sc->chunk) ? sc->chunk : len;
+        while (len > 0)
+        {
+            size_t consumed = 0;
+            chanmux_nic_rx_parser_event_t event = chanmux_nic_rx_parser_feed(
+                                                      &parser,
+                                                      &rx_fifo.buf[pos],
+                                                      len,
+                                                      &consumed);
+            pos += consumed;
+            len -= consumed;
+            if (CHANMUX_NIC_RX_PARSER_NEED_BUFFER == event)
+            {
+                chanmux_nic_rx_parser_set_buffer(&parser, frame_buf);
+            }
+            else if (CHANMUX_NIC_RX_PARSER_FRAME == event)
+            {
+                cnt.rx_frames++;
+                cnt.rx_bytes += chanmux_nic_rx_parser_get_frame_len(&parser);
+            }
+        }
+    }
+    count_copies = false;
+    sec = now_sec() - start;
+    report("PA", sc, cnt.rx_frames, cnt.rx_bytes, 0, sec);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+static void
+usage(
+    const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  -m <mix>    frame mix: small, large, jumbo, imix\n"
+           "  -n <num>    number of frames\n"
+           "  -c <bytes>  max bytes returned by one ChanMux read\n"
+           "  -z          RX zero-copy mode\n"
+           "  -b <num>    RX notification batch size\n"
+           "  -p <bytes>  RX polling budget\n"
+           "  -r          RX blocking read instead of wait and read\n"
+           "  -t          TX zero-copy mode\n"
+           "  -y          TX zero-copy option with a separate network stack "
+           "port,\n"
+           "              frames are copied from behind the headroom\n"
+           "  -a <num>    TX aggregation frame count\n"
+           "  -q <bytes>  TX queue size\n"
+           "  -k <num>    TX priority classes, small frames first, needs -q\n"
+           "  -w <bytes>  max bytes taken by one ChanMux write\n"
+           "  -l          trace latencies and print the histograms\n"
+           "  -f          RX framing v2 with sync marker, sequence and CRC\n"
+           "  -e <num>    corrupt every num-th RX frame, needs -f\n"
+           "  -s <num>    RX clients, UDP flows are steered by hash\n"
+           "  -x <num>    RX filter, every num-th frame is for another host\n"
+           "  -o          checksum offload, RX and TX frames are IPv4/UDP\n"
+           "  -g <num>    LRO, RX frames are TCP segments in bursts of num per "
+           "flow\n"
+           "  -u <num>    TSO, TX frames are sent as TCP segments of num frames\n"
+           "without -m, all frame mixes and a set of chunk sizes are run\n",
+           name);
+}
+
+//------------------------------------------------------------------------------
+int
+main(
+    int argc,
+    char *argv[])
+{
+    scenario_t sc = { .frames = 100000, .chunk = BENCH_PORT_SIZE };
+    bool run_matrix = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:c:zb:p:rtya:q:k:w:lfe:s:x:og:u:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            for (size_t i = 0; i < sizeof(frame_mixes) / sizeof(frame_mixes[0]); i++)
+            {
+                if (0 == strcmp(optarg, frame_mixes[i].name))
+                {
+                    sc.mix = &frame_mixes[i];
+                }
+            }
+            if (NULL == sc.mix)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            run_matrix = false;
+            break;
+        case 'n':
+            sc.frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            sc.chunk = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            sc.rx_zero_copy = true;
+            break;
+        case 'b':
+            sc.rx_batch = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            sc.rx_poll = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            sc.rx_read_blocking = true;
+            break;
+        case 't':
+            sc.tx_zero_copy = true;
+            break;
+        case 'y':
+            sc.tx_headroom = true;
+            break;
+        case 'a':
+            sc.tx_aggregate = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            sc.tx_queue = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            sc.tx_classes = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            sc.tx_write = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            sc.latency = true;
+            break;
+        case 'f':
+            sc.framing_v2 = true;
+            break;
+        case 'e':
+            sc.corrupt = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            sc.rx_clients = strtoul(optarg, NULL, 0);
+            break;
+        case 'x':
+            sc.rx_foreign = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            sc.csum = true;
+            break;
+        case 'g':
+            sc.lro = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            sc.tso = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if ((0 == sc.chunk) || (sc.chunk > BENCH_PORT_SIZE))
+    {
+        printf("chunk size must be 1 - %d\n", BENCH_PORT_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    if (sc.tx_queue > BENCH_TX_QUEUE_MAX)
+    {
+        printf("TX queue size must be 0 - %d\n", BENCH_TX_QUEUE_MAX);
+        return EXIT_FAILURE;
+    }
+
+    if ((0 != sc.tso) && sc.tx_zero_copy)
+    {
+        printf("TSO is not possible in TX zero-copy mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sc.rx_clients > CHANMUX_NIC_DRV_RX_CLIENTS_MAX)
+    {
+        printf("RX clients must be 0 - %d\n", CHANMUX_NIC_DRV_RX_CLIENTS_MAX);
+        return EXIT_FAILURE;
+    }
+
+    if (!run_matrix)
+    {
+        return (0 == run_scenario(&sc)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    static const size_t chunks[] = { 64, 512, BENCH_PORT_SIZE };
+    for (size_t m = 0; m < sizeof(frame_mixes) / sizeof(frame_mixes[0]); m++)
+    {
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+        {
+            sc.mix = &frame_mixes[m];
+            sc.chunk = chunks[c];
+            if (0 != run_scenario(&sc))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+/*
+ * seL4 stand-in for the host benchmark
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+// the benchmark counts how often the driver yields
+void seL4_Yield(void);
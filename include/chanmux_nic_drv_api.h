@@ -11,17 +11,194 @@
 #pragma once
 
 #include "OS_Error.h"
+#include "OS_Types.h"
 #include "OS_Dataport.h"
 #include "ChanMux/ChanMuxCommon.h"
+#include "network/OS_NetworkTypes.h"
+#include "network/OS_NetworkStackTypes.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+// Space in front of a TX frame in network_stack.from if tx.zero_copy is set,
+// the driver puts the 2 byte frame length prefix there.
+#define CHANMUX_NIC_DRV_TX_HEADROOM     2
+
+// ChanMUX NIC protocol extension to get the link capabilities. The 10 byte
+// response has status and context byte, a version, the max frames per write,
+// then the max frame length, the framing features and the offloads as uint16
+// in big endian.
+#define CHANMUX_NIC_CMD_GET_CAPS        0x10
+#define CHANMUX_NIC_RSP_GET_CAPS        0x10
+#define CHANMUX_NIC_GET_CAPS_RSP_LEN    10
+
+// Enable features the peer has announced in the GET_CAPS response. The command
+// has the features as uint16 in big endian after the channel ID, the response
+// is 2 byte status.
+#define CHANMUX_NIC_CMD_SET_FEATURES    0x11
+#define CHANMUX_NIC_RSP_SET_FEATURES    0x11
+
+// Framing features
+//
+// CHANMUX_NIC_FEATURE_RX_FRAMING_V2: the peer sends frames as
+//   2 byte sync 0xC3 0x5A | 2 byte sequence number | 2 byte frame length |
+//   2 byte inverted frame length | frame data | 4 byte CRC-32 of the data
+// with all numbers in big endian. The sequence number increments per frame.
+// The receiver can skip a corrupted frame, find the next sync marker in-band
+// and count the frames that were lost, without stopping the data channel.
+// Frames the driver sends keep the plain 2 byte length prefix.
+#define CHANMUX_NIC_FEATURE_RX_FRAMING_V2   0x0001
+
+// Set in OS_NetworkStack_RxBuffer_t.len if rx.chain_slots is enabled and the
+// frame continues in the next ring slot. The length without the flags is the
+// number of bytes in the slot.
+#define CHANMUX_NIC_DRV_RX_LEN_CHAINED  ((size_t)1 << (sizeof(size_t) * 8 - 1))
+// Set in OS_NetworkStack_RxBuffer_t.len of the last slot of a frame if
+// rx.csum_offload is enabled and the IP header and TCP/UDP checksums of the
+// frame are correct.
+#define CHANMUX_NIC_DRV_RX_LEN_CSUM_OK  ((size_t)1 << (sizeof(size_t) * 8 - 2))
+#define CHANMUX_NIC_DRV_RX_LEN_FLAGS \
+    (CHANMUX_NIC_DRV_RX_LEN_CHAINED | CHANMUX_NIC_DRV_RX_LEN_CSUM_OK)
+
+// RX filter settings, see chanmux_nic_driver_rpc_set_rx_filter()
+#define CHANMUX_NIC_DRV_RX_FILTER_PROMISC   0x0001 // accept all frames
+#define CHANMUX_NIC_DRV_RX_FILTER_ALL_MULTI 0x0002 // accept all multicast
+
+// RX flow steering, max network stack clients and rules and the length of the
+// Toeplitz hash key
+#define CHANMUX_NIC_DRV_RX_CLIENTS_MAX      4
+#define CHANMUX_NIC_DRV_RX_STEER_RULES_MAX  8
+#define CHANMUX_NIC_DRV_RX_STEER_KEY_LEN    40
+// the hash input is up to 36 bytes, an IPv6 address pair and the ports
+#define CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES \
+    ((CHANMUX_NIC_DRV_RX_STEER_KEY_LEN - 4) * 2)
+
+typedef enum
+{
+    CHANMUX_NIC_DRV_STEER_NONE = 0,  // unused rule
+    CHANMUX_NIC_DRV_STEER_VLAN_ID,   // VLAN ID of a tagged frame is value
+    CHANMUX_NIC_DRV_STEER_ETHERTYPE, // ethertype, after a VLAN tag, is value
+    CHANMUX_NIC_DRV_STEER_DST_MAC    // destination MAC is mac
+} chanmux_nic_drv_steer_match_t;
+
+// RX steering rule, frames that match go to the given client
+typedef struct
+{
+    chanmux_nic_drv_steer_match_t match;
+    uint16_t value;
+    uint8_t mac[MAC_SIZE];
+    unsigned int client;
+} chanmux_nic_drv_steer_rule_t;
+
+// returns a monotonic time in nanoseconds
+typedef uint64_t (*chanmux_nic_drv_get_time_func_t)(void);
+
+// waits for an event like event_wait_func_t, but for timeout_ns at most.
+// Returns false if the timeout expired.
+typedef bool (*chanmux_nic_drv_wait_timeout_func_t)(uint64_t timeout_ns);
+
+// reads from a ChanMUX channel like ChanMux_ChannelOpsCtx_t.func.read(), but
+// blocks until there is data
+typedef OS_Error_t (*chanmux_nic_drv_read_blocking_func_t)(
+    unsigned int id,
+    size_t len,
+    size_t *len_read);
+
+// Max number of TX priority classes.
+#define CHANMUX_NIC_DRV_TX_CLASSES_MAX      4
+
+// Latency histograms use fixed power of two buckets. Bucket 0 counts latencies
+// below 128 ns, bucket i counts [2^(i+6), 2^(i+7)) ns and the last bucket also
+// everything above, which starts at about 0.5 s.
+#define CHANMUX_NIC_DRV_LATENCY_BUCKETS     24
+
+// The stack consumption time can be traced for this many RX ring slots only.
+#define CHANMUX_NIC_DRV_LATENCY_MAX_SLOTS   64
+
+typedef enum
+{
+    CHANMUX_NIC_DRV_LATENCY_RX_DATA_WAIT = 0, // blocked waiting for ChanMUX data
+    CHANMUX_NIC_DRV_LATENCY_RX_READ,          // ChanMUX read() RPC, a blocking
+                                              // read includes the wait
+    CHANMUX_NIC_DRV_LATENCY_RX_PARSE,         // parsing and copying a chunk
+    CHANMUX_NIC_DRV_LATENCY_RX_SLOT_WAIT,     // waiting for a free ring slot
+    // Time from handing a slot to the network stack until the driver sees it
+    // released. This is recorded only if the driver had to wait for the slot,
+    // so it shows the stack's consumption under back pressure.
+    CHANMUX_NIC_DRV_LATENCY_RX_STACK,
+    CHANMUX_NIC_DRV_LATENCY_TX,               // chanmux_nic_driver_rpc_tx_data()
+    CHANMUX_NIC_DRV_LATENCY_STAGES
+} chanmux_nic_drv_latency_stage_t;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bucket[CHANMUX_NIC_DRV_LATENCY_BUCKETS];
+} chanmux_nic_drv_latency_hist_t;
+
+// Driver statistics. The RX counters are updated by the driver loop only, the
+// TX counters by the TX RPCs only and the control channel counters under the
+// control channel mutex, so no further lock is needed. A reader may see a set
+// of counters that is not updated consistently.
+typedef struct
+{
+    uint64_t rx_frames;          // frames handed over to the network stack
+    uint64_t rx_bytes;           // bytes in these frames
+    uint64_t rx_dropped;         // frames dropped for zero or oversize length
+    uint64_t rx_overflows;       // ChanMUX FIFO overflows reported by read()
+    uint64_t rx_read_errors;     // other read() failures
+    uint64_t rx_resets;          // FIFO resets done for error recovery
+    uint64_t rx_empty_reads;     // spurious wake-ups, blocking reads or
+                                 // ChanMUX events without data
+    uint64_t rx_polled_reads;    // reads done without waiting for an event
+    uint64_t rx_poll_empty;      // polled reads without data, polling stops
+    uint64_t rx_ring_full;       // times a frame found the next slot in use
+    uint64_t rx_slot_waits;      // yield or blocked iterations for a slot
+    uint64_t rx_notifications;   // notifications sent to the network stack
+    uint64_t rx_client_frames[CHANMUX_NIC_DRV_RX_CLIENTS_MAX]; // frames per
+                                                               // stack client
+    uint64_t rx_filtered;        // frames dropped by the RX filter
+    uint64_t rx_csum_ok;         // frames with verified checksums
+    // only updated with LRO
+    uint64_t rx_lro_merged;      // TCP segments merged into the frame before
+    uint64_t rx_lro_dropped;     // segments dropped for a checksum error while
+                                 // they were merged
+    // only updated with RX framing v2
+    uint64_t rx_crc_errors;      // frames dropped for a CRC mismatch
+    uint64_t rx_resyncs;         // times the driver searched the next sync marker
+    uint64_t rx_lost_frames;     // frames missing in the sequence numbers
+    uint64_t tx_frames;          // frames accepted from the network stack
+    uint64_t tx_bytes;           // bytes in these frames
+    uint64_t tx_dropped;         // frames lost because writing failed
+    uint64_t tx_writes;          // ChanMUX write() calls
+    uint64_t tx_partial_writes;  // write() calls that did not take all data
+    uint64_t tx_csum_filled;     // frames the driver set checksums in
+    uint64_t tx_tso_frames;      // TCP segments split by TSO, tx_frames
+                                 // counts the parts
+    // only updated with a TX queue
+    uint64_t tx_queue_bytes;     // bytes queued, including length prefixes
+    uint64_t tx_queue_frames;    // frames queued, including a partly sent one
+    uint64_t tx_queue_peak;      // max bytes ever queued
+    uint64_t tx_queue_stops;     // frames refused, the queue was too full
+    uint64_t tx_class_frames[CHANMUX_NIC_DRV_TX_CLASSES_MAX]; // frames taken
+                                                              // per class
+    uint64_t ctrl_timeouts;      // control commands without timely response
+    // only updated if stats.latency is enabled
+    chanmux_nic_drv_latency_hist_t latency[CHANMUX_NIC_DRV_LATENCY_STAGES];
+} chanmux_nic_drv_stats_t;
+
 typedef struct
 {
     struct
     {
         ChanMux_ChannelOpsCtx_t ctrl;
         ChanMux_ChannelOpsCtx_t data;
+        // Optional, a single call that waits for data on the data channel and
+        // reads it. Without it, the driver waits for the data event and calls
+        // data.func.read() then.
+        chanmux_nic_drv_read_blocking_func_t data_read_blocking;
     } chanmux;
 
     struct
@@ -29,6 +206,10 @@ typedef struct
         OS_Dataport_t to;           // NIC -> stack
         OS_Dataport_t from;         // stack -> NIC
         event_notify_func_t notify; // one ore more frames are available
+        // Optional, blocks until the network stack has released an RX slot.
+        // The stack must signal this after it has cleared the slot length.
+        // If not set, the driver yields while it waits for a free slot.
+        event_wait_func_t rx_slot_wait;
     } network_stack;
 
     struct
@@ -37,13 +218,515 @@ typedef struct
         mutex_unlock_func_t unlock;
     } nic_control_channel_mutex;
 
+    struct
+    {
+        // Parse frames directly from the ChanMux read dataport instead of
+        // copying each chunk into an intermediate buffer first. This requires
+        // that the read and write dataport of the data channel do not share
+        // the same memory, otherwise the driver falls back to the copy mode.
+        bool zero_copy;
+        // Max number of frames put into the ring before the network stack is
+        // notified. Pending frames are always announced when the ring is full
+        // or before the driver blocks waiting for ChanMUX data, so this just
+        // bounds the latency under bursty traffic. 0 and 1 notify per frame.
+        unsigned int batch_max_frames;
+        // Number of OS_NetworkStack_RxBuffer_t slots in the RX ring, the
+        // network stack must use the same value. 0 uses as many slots as fit
+        // into network_stack.to.
+        unsigned int ring_elements;
+        // Frames bigger than a ring slot are put into consecutive slots, all
+        // but the last one have CHANMUX_NIC_DRV_RX_LEN_CHAINED set in the
+        // length. The network stack must process a chain only once its last
+        // slot is set and release all slots of it. Without this, such frames
+        // are dropped. The ring must be big enough for the largest frame.
+        bool chain_slots;
+        // Max bytes read from the ChanMUX FIFO without waiting for the data
+        // event. After an event the driver keeps reading until a read returns
+        // nothing or the budget is used up, then it blocks on the event again.
+        // The budget in use adapts to the load, it doubles when used up and
+        // halves when the FIFO runs empty. 0 disables polling.
+        size_t poll_budget;
+        // Drop frames that are not for us before they are copied into the
+        // RX ring: unicast to other MACs and multicast the network stack has
+        // not asked for with chanmux_nic_driver_rpc_set_rx_filter(). Until it
+        // does, all multicast passes. Broadcast always passes. Unicast is not
+        // filtered if the MAC could not be read from the peer.
+        bool filter;
+        // Verify the IPv4 header and the TCP/UDP checksum of IPv4 and IPv6
+        // frames while they are copied into the RX ring and set
+        // CHANMUX_NIC_DRV_RX_LEN_CSUM_OK if they are correct. The network
+        // stack can skip its own check then. Frames without the flag are
+        // delivered as usual, they are not IP, have bad checksums or use
+        // fragments or IPv6 extension headers the driver does not look into.
+        bool csum_offload;
+        // Large receive offload. In-order TCP segments of a flow that arrive
+        // back to back are merged into one frame, so the network stack gets
+        // fewer and bigger frames. Only IPv4 segments without IP options and
+        // fragments are merged, they must carry data, have no flags but ACK
+        // and PSH and the same TCP options. Their checksums are verified, the
+        // merged frame gets a new IP length and new checksums. It is handed
+        // over after a segment with PSH, when a frame of another flow comes,
+        // when the next segment does not fit, after timeout_ns and before the
+        // driver waits for ChanMUX data. This requires chain_slots.
+        struct
+        {
+            // Max length of a merged frame, 0 disables LRO.
+            size_t max_len;
+            // Max time in nanoseconds the first segment waits. This requires
+            // the clock. 0 disables the timeout.
+            uint64_t timeout_ns;
+        } lro;
+        // Steer RX frames to several network stack clients, each with an RX
+        // ring of its own. network_stack is client 0, it gets all frames the
+        // steering does not pick another client for. TX and the MAC stay
+        // with client 0. The ring settings above apply to all clients. A
+        // client with a full ring blocks the others, as the frames arrive
+        // through one ChanMUX channel.
+        struct
+        {
+            // Number of clients, 0 and 1 use network_stack only.
+            unsigned int clients;
+            // Clients 1 and up, the same as in network_stack.
+            struct
+            {
+                OS_Dataport_t to;
+                event_notify_func_t notify;
+                event_wait_func_t rx_slot_wait;
+            } client[CHANMUX_NIC_DRV_RX_CLIENTS_MAX - 1];
+            // Checked in order, the first matching rule picks the client.
+            chanmux_nic_drv_steer_rule_t rules[CHANMUX_NIC_DRV_RX_STEER_RULES_MAX];
+            // Spread IPv4 and IPv6 frames no rule matches over all clients by
+            // a Toeplitz hash of the addresses and the TCP/UDP ports, so a
+            // flow always goes to the same client and keeps its order.
+            bool hash;
+            // All zero uses the common default RSS key.
+            uint8_t hash_key[CHANMUX_NIC_DRV_RX_STEER_KEY_LEN];
+        } steering;
+    } rx;
+
+    struct
+    {
+        // The network stack writes a TX frame at offset
+        // CHANMUX_NIC_DRV_TX_HEADROOM in network_stack.from. If this dataport
+        // is also the write dataport of the ChanMUX data channel, the driver
+        // just fills in the length prefix and sends the frame without copying
+        // it. It must not be the read dataport as well then. If
+        // network_stack.from is bigger than the write dataport, the part of a
+        // frame beyond it is copied in chunks. Aggregation is not possible
+        // then, as each frame overwrites the port. Otherwise the frame is
+        // copied from the headroom offset.
+        bool zero_copy;
+        // Max number of frames packed back to back into the ChanMUX write
+        // port before they are sent with one write() call. The port is also
+        // flushed when it is full or the deadline has expired. 0 and 1 send
+        // every frame immediately. Without a TX queue, this is not possible if
+        // the ChanMUX data channel uses one dataport for read and write.
+        unsigned int aggregate_max_frames;
+        // Max time in nanoseconds a frame waits in the port. This requires
+        // the clock and is checked on every TX call and in
+        // chanmux_nic_driver_rpc_tx_poll(). 0 disables the deadline.
+        uint64_t aggregate_deadline_ns;
+        // Fill in the IPv4 header and the TCP/UDP checksum of IPv4 and IPv6
+        // frames where the network stack has left them zero. The sum is
+        // taken while the frame is copied into the ChanMUX write port, a
+        // queued or zero-copy frame needs an extra pass over the data.
+        bool csum_offload;
+        // Optional memory for a TX queue. Frames are copied into it and
+        // written to ChanMUX from there, as much as fits into the write port.
+        // If ChanMUX takes only a part, the rest stays queued and is written
+        // by the next TX call or chanmux_nic_driver_rpc_tx_poll(), instead of
+        // dropping the frame. The aggregation settings above decide when the
+        // queued frames are written. Not possible in TX zero-copy mode.
+        struct
+        {
+            void *buffer;
+            size_t size;
+            // Once a frame does not fit below the high watermark, TX calls
+            // fail with OS_ERROR_TRY_AGAIN until the queue has drained to the
+            // low watermark. Both are in bytes, including a 2 byte length
+            // prefix per frame. 0 uses the queue size and half of the high
+            // watermark.
+            size_t high_watermark;
+            size_t low_watermark;
+            // Number of priority classes, each gets an equal part of the
+            // queue and the watermarks. The high watermark of a class must
+            // hold a max size Ethernet frame. Class 0 is always written first,
+            // the others share the link by deficit round robin. 0 and 1 use a
+            // single class. Frames are classified in this order:
+            //   ARP, ICMP and ICMPv6 go to control_class
+            //   VLAN tagged frames go to pcp_class[priority code point]
+            //   frames up to small_len bytes, e.g. TCP ACKs, to small_class
+            //   all others go to default_class
+            unsigned int classes;
+            unsigned int control_class;
+            uint8_t pcp_class[8];
+            size_t small_len;
+            unsigned int small_class;
+            unsigned int default_class;
+            // bytes a class may write per round, 0 is a max size frame
+            size_t quantum[CHANMUX_NIC_DRV_TX_CLASSES_MAX];
+        } queue;
+    } tx;
+
+    struct
+    {
+        // Query the link capabilities with CHANMUX_NIC_CMD_GET_CAPS at init.
+        // If the peer answers with an error status only, defaults are used
+        // that match the plain ChanMUX NIC protocol. A peer that does not
+        // answer unknown commands at all makes the init time out.
+        bool get_caps;
+        // Max time in nanoseconds a control command waits for its response,
+        // then it fails with OS_ERROR_TIMEOUT. This requires the clock and
+        // wait_timeout. 0 waits forever.
+        uint64_t timeout_ns;
+        // Waits for the control channel event like chanmux.ctrl.wait, but not
+        // longer than the time left for a command. Only needed for
+        // timeout_ns, as the timeout can't fire while the driver blocks on
+        // the event otherwise.
+        chanmux_nic_drv_wait_timeout_func_t wait_timeout;
+        // Optional, a counting semaphore that callers block on while another
+        // caller reads the control channel for them. The reader posts it
+        // once for every waiting caller after it has dispatched responses,
+        // so it must not lose posts that come before the wait, like a CAmkES
+        // semaphore does. If not set, these callers yield.
+        event_wait_func_t rsp_wait;
+        event_notify_func_t rsp_notify;
+    } ctrl;
+
+    struct
+    {
+        // Optional, features that need a time source are disabled without it.
+        chanmux_nic_drv_get_time_func_t get_time_ns;
+    } clock;
+
+    struct
+    {
+        // Optional, the driver keeps its counters in this dataport, so a
+        // monitoring component can read them without an RPC. It must have
+        // room for a chanmux_nic_drv_stats_t.
+        OS_Dataport_t port;
+        // Record latency histograms for the RX and TX stages. This requires
+        // the clock and costs a few clock reads per frame.
+        bool latency;
+    } stats;
+
 } chanmux_nic_drv_config_t;
 
+// Max number of control requests in flight and max size of a response.
+#define CHANMUX_NIC_DRV_CTRL_MAX_PENDING    4
+#define CHANMUX_NIC_DRV_CTRL_RSP_MAX        32
+
+// Link parameters, set up when the channel is opened.
+typedef struct
+{
+    bool mac_valid;
+    uint8_t mac[MAC_SIZE];
+    uint16_t max_frame_len;   // largest frame the peer sends or accepts
+    uint8_t max_batch_frames; // max frames the peer takes in one write, 0 is any
+    uint16_t features;        // negotiated framing features
+    uint16_t offloads;        // negotiated offloads
+} chanmux_nic_drv_caps_t;
+
+// TCP segment as large receive offload sees it
+typedef struct
+{
+    size_t ip;            // IPv4 header offset
+    size_t hdr_len;       // Ethernet, IPv4 and TCP header
+    size_t payload_len;
+    uint32_t seq;
+    uint8_t flags;        // TCP flags
+    uint64_t hdr_sum;     // partial checksum sum of the headers
+    uint64_t tcp_sum;     // partial sum of the TCP and the pseudo header
+} chanmux_nic_drv_rx_lro_seg_t;
+
+// Large receive offload state. The frame segments are merged into is held in
+// the ring of its client, its last slot has no length until it is handed over.
+typedef struct
+{
+    size_t max_len;       // 0 if LRO is disabled
+    chanmux_nic_drv_rx_lro_seg_t seg; // the frame in progress
+    bool candidate;       // the frame in progress can be held
+    bool append;          // the frame in progress goes behind the held frame
+    size_t buf_used;      // bytes in the slot the appended data starts in
+    bool held;
+    unsigned int client;
+    unsigned int first;   // first slot of the held frame
+    unsigned int slots;   // slots of the held frame
+    size_t tail_len;      // bytes in its last slot
+    size_t len;           // held frame length
+    size_t hdr_len;       // its Ethernet, IPv4 and TCP header
+    size_t ip;            // its IPv4 header offset
+    unsigned int segs;    // segments in the held frame
+    uint32_t next_seq;    // sequence number a segment must have to be merged
+    uint64_t payload_sum; // partial checksum sum of the TCP payload
+    bool push;            // the last segment had PSH set
+    uint64_t start_ns;    // time when the first segment was held
+} chanmux_nic_drv_rx_lro_t;
+
+// RX ring of a network stack client
+typedef struct
+{
+    OS_NetworkStack_RxBuffer_t *ring;
+    unsigned int ring_elements;
+    unsigned int pos;           // next ring slot to fill
+    unsigned int batch_frames;  // frames the client was not notified about
+    event_notify_func_t notify;
+    event_wait_func_t rx_slot_wait;
+} chanmux_nic_drv_rx_client_t;
+
+// TX queue of a priority class, a ring buffer with frames in the ChanMUX
+// stream format
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t high_watermark;
+    size_t low_watermark;
+    size_t quantum;       // deficit round robin bytes per round
+    size_t head;          // offset where the next frame is added
+    size_t tail;          // offset of the next byte to write
+    size_t used;          // bytes in the queue
+    unsigned int frames;  // frames in the queue
+    bool stopped;         // refuse frames until the low watermark
+} chanmux_nic_drv_tx_queue_t;
+
+// TX scheduler state
+typedef struct
+{
+    unsigned int rr;      // class served by deficit round robin
+    size_t deficit[CHANMUX_NIC_DRV_TX_CLASSES_MAX];
+} chanmux_nic_drv_tx_sched_t;
+
+typedef struct
+{
+    uint8_t state;
+    uint32_t seq;
+    uint64_t deadline_ns; // 0 if there is no timeout
+    size_t rsp_len;
+    size_t rsp_received;
+    bool status_first;    // the response may end after an error status
+    uint8_t rsp[CHANMUX_NIC_DRV_CTRL_RSP_MAX];
+} chanmux_nic_drv_ctrl_req_t;
+
+// Driver context, one per ChanMUX NIC. The caller provides the memory, the
+// content is internal to the driver and must not be accessed directly.
+typedef struct
+{
+    const chanmux_nic_drv_config_t *config;
+    OS_SharedBuffer_t network_stack_port_to;
+    OS_SharedBuffer_t network_stack_port_from;
+    chanmux_nic_drv_caps_t caps;
+
+    struct
+    {
+        bool zero_copy;
+        unsigned int clients;     // network stack clients, at least 1
+        unsigned int cur;         // client of the frame in progress
+        chanmux_nic_drv_rx_client_t client[CHANMUX_NIC_DRV_RX_CLIENTS_MAX];
+        unsigned int chain_slots; // slots filled for an incomplete frame
+        // Set by chanmux_nic_driver_rpc_set_rx_filter() and read by the
+        // driver loop without a lock. A frame that arrives during an update
+        // may be filtered with the old settings.
+        struct
+        {
+            bool enabled;
+            uint32_t flags;
+            uint64_t mcast_hash;
+        } filter;
+        chanmux_nic_drv_rx_lro_t lro;
+        size_t poll_budget; // current adaptive polling budget in bytes
+        size_t poll_left;   // bytes left to read before waiting again
+        // intermediate buffer if frames are not parsed in the read dataport
+        uint8_t staging_buffer[ETHERNET_FRAME_MAX_SIZE];
+        // steering hash per nibble value and position, made from the key
+        uint32_t steer_hash_table[CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES][16];
+    } rx;
+
+    struct
+    {
+        bool zero_copy;
+        struct
+        {
+            size_t port_offset;      // bytes pending in the ChanMUX write port
+            unsigned int frames;     // frames pending in the ChanMUX write port
+            uint64_t first_frame_ns; // time when the first frame was added
+            size_t frame_left;       // bytes left of a partly written frame
+            bool disabled;           // the write port is also the read port
+        } aggr;
+        struct
+        {
+            unsigned int classes;    // 0 if there is no TX queue
+            chanmux_nic_drv_tx_queue_t q[CHANMUX_NIC_DRV_TX_CLASSES_MAX];
+            chanmux_nic_drv_tx_sched_t sched;
+            unsigned int current;    // class of a partly written frame
+            size_t frame_left;       // bytes left of a partly written frame
+            bool retry;              // ChanMUX did not take all data
+        } queue;
+    } tx;
+
+    // Control channel requests. The peer answers in order, so responses are
+    // matched to the requests by a sequence number. All fields are protected
+    // by nic_control_channel_mutex.
+    struct
+    {
+        chanmux_nic_drv_ctrl_req_t req[CHANMUX_NIC_DRV_CTRL_MAX_PENDING];
+        uint32_t req_seq;            // sequence number of the next request
+        uint32_t rsp_seq;            // sequence number of the next response
+        bool reader_active;          // a caller blocks on the channel event
+        unsigned int waiters;        // callers waiting for the reader
+        uint32_t wake_gen;           // incremented when they are woken
+        uint64_t waiter_deadline_ns; // earliest deadline of these, 0 if none
+    } ctrl;
+
+    struct
+    {
+        bool enabled;
+        // time when a ring slot was handed over to the network stack
+        uint64_t slot_ns[CHANMUX_NIC_DRV_LATENCY_MAX_SLOTS];
+    } latency;
+
+    // points to stats_buffer or into the stats dataport
+    chanmux_nic_drv_stats_t *stats;
+    chanmux_nic_drv_stats_t stats_buffer;
+
+} chanmux_nic_drv_t;
+
+/**
+ * @brief initialize a driver context
+ *
+ * One component can serve several ChanMUX NICs, each with its own context and
+ * configuration. The context and the configuration must stay valid as long as
+ * the driver is used.
+ *
+ * @param ctx driver context to initialize
+ * @param config configuration for the driver
+ *
+ * @return OS_ERROR_INVALID_PARAMETER invalid parameter or RX ring does not
+ *  fit into the dataport
+ * @return OS_ERROR_GENERIC initialization failed
+ * @return OS_SUCCESS initialization successful
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_init(
+    chanmux_nic_drv_t *ctx,
+    const chanmux_nic_drv_config_t *config);
+
+/**
+ * @brief run the driver main loop of a context
+ *
+ * This function does not return in normal operation, so each context needs a
+ * thread of its own.
+ *
+ * @param ctx driver context
+ *
+ * @return OS_ERROR_GENERIC driver main loop failed
+ * @return OS_SUCCESS driver main loop terminated gracefully
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_run(
+    chanmux_nic_drv_t *ctx);
+
+/**
+ * @brief send a frame from the network stack output dataport
+ *
+ * @param ctx driver context
+ * @param pLen frame length, receives the length sent
+ *
+ * @return OS_ERROR_GENERIC sending the frame failed
+ * @return OS_ERROR_TRY_AGAIN the TX queue is full, or with TX aggregation the
+ *  data ChanMUX did not take leaves no room in the write port. The frame was
+ *  not taken.
+ * @return OS_SUCCESS frame sent or queued for sending
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_data(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen);
+
+/**
+ * @brief see chanmux_nic_driver_rpc_tx_data_tso()
+ *
+ * @param ctx driver context
+ * @param pLen segment length, receives the length sent
+ * @param mss max TCP payload per frame
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_data_tso(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen,
+    size_t mss);
+
+/**
+ * @brief see chanmux_nic_driver_rpc_tx_flush()
+ *
+ * @param ctx driver context
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_flush(
+    chanmux_nic_drv_t *ctx);
+
+/**
+ * @brief see chanmux_nic_driver_rpc_tx_poll()
+ *
+ * @param ctx driver context
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_poll(
+    chanmux_nic_drv_t *ctx);
+
+/**
+ * @brief get the MAC into the first RX slot of the network stack input
+ *
+ * The MAC is read when the channel is opened, so usually no control channel
+ * round trip is needed.
+ *
+ * @param ctx driver context
+ *
+ * @return OS_ERROR_GENERIC getting the MAC failed
+ * @return OS_SUCCESS MAC is in the first RX slot
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_get_mac(
+    chanmux_nic_drv_t *ctx);
+
+/**
+ * @brief see chanmux_nic_driver_rpc_set_rx_filter()
+ *
+ * @param ctx driver context
+ * @param flags CHANMUX_NIC_DRV_RX_FILTER_xxx
+ * @param mcast_hash multicast hash table
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_set_rx_filter(
+    chanmux_nic_drv_t *ctx,
+    uint32_t flags,
+    uint64_t mcast_hash);
+
+/**
+ * @brief get a snapshot of the driver statistics
+ *
+ * @param ctx driver context
+ * @param stats receives the counters
+ *
+ * @return OS_ERROR_INVALID_PARAMETER stats is NULL
+ * @return OS_SUCCESS counters copied
+ */
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_get_stats(
+    const chanmux_nic_drv_t *ctx,
+    chanmux_nic_drv_stats_t *stats);
+
+//------------------------------------------------------------------------------
+// The functions below use a default context, they are kept for components that
+// serve one ChanMUX NIC only.
+//------------------------------------------------------------------------------
+
 /**
  * @brief initialize the driver
  *
  * @param config configuration for the driver
  *
+ * @return OS_ERROR_INVALID_PARAMETER RX ring does not fit into the dataport
  * @return OS_ERROR_GENERIC initialization failed
  * @return OS_SUCCESS initialization successful
  */
@@ -60,9 +743,124 @@ chanmux_nic_driver_init(
 OS_Error_t
 chanmux_nic_driver_run(void);
 
+/**
+ * @brief see chanmux_nic_driver_ctx_rpc_tx_data()
+ *
+ * @param pLen frame length, receives the length sent
+ */
 OS_Error_t
 chanmux_nic_driver_rpc_tx_data(
     size_t *pLen);
 
+/**
+ * @brief send a TCP segment bigger than the MSS from the network stack output
+ *  dataport (TSO)
+ *
+ * The driver splits the segment into frames with at most mss bytes of TCP
+ * payload. Each frame gets the headers of the segment with the IP length, the
+ * IPv4 ID counting up from the one of the segment, its TCP sequence number
+ * and all checksums set. CWR goes with the first frame, FIN and PSH with the
+ * last one. The frames are packed into as few ChanMUX writes as possible.
+ * With a TX queue they are queued all or none, unless they exceed the high
+ * watermark, then the queue is drained in between. The segment can be as big
+ * as the dataport, an IPv4 or IPv6 packet is limited to 64 KiB anyway. IPv4 and
+ * IPv6 without extension headers are split, any other frame is sent like with
+ * chanmux_nic_driver_rpc_tx_data(). Not possible in TX zero-copy mode. If
+ * tx.zero_copy is set but the network stack output is a separate port, the
+ * segment starts behind the TX headroom there, like a frame for
+ * chanmux_nic_driver_rpc_tx_data().
+ *
+ * @param pLen segment length, receives the length sent
+ * @param mss max TCP payload per frame
+ *
+ * @return OS_ERROR_NOT_SUPPORTED TX zero-copy mode is enabled
+ * @return OS_ERROR_GENERIC sending the frames failed
+ * @return OS_ERROR_TRY_AGAIN the TX queue is full, or with TX aggregation the
+ *  data ChanMUX did not take leaves no room in the write port. The segment
+ *  was not taken.
+ * @return OS_SUCCESS all frames sent or queued for sending
+ */
+OS_Error_t
+chanmux_nic_driver_rpc_tx_data_tso(
+    size_t *pLen,
+    size_t mss);
+
+/**
+ * @brief send all frames pending in the TX aggregation immediately
+ *
+ * Latency sensitive callers use this after queuing a frame that must not wait
+ * for the aggregation threshold or deadline. It must not be called
+ * concurrently with chanmux_nic_driver_rpc_tx_data().
+ *
+ * @return OS_ERROR_GENERIC pending frames could not be sent and are dropped,
+ *  with a TX queue they are kept
+ * @return OS_ERROR_TRY_AGAIN ChanMUX did not take all data, the rest stays in
+ *  the TX queue or the ChanMUX write port
+ * @return OS_SUCCESS no frames pending or all frames sent
+ */
+OS_Error_t
+chanmux_nic_driver_rpc_tx_flush(void);
+
+/**
+ * @brief send frames pending in the TX aggregation if the deadline expired
+ *
+ * The network stack calls this periodically, so the deadline is kept even if
+ * no further frames are sent. It also retries data ChanMUX did not take. It
+ * must not be called concurrently with chanmux_nic_driver_rpc_tx_data().
+ *
+ * @return OS_ERROR_GENERIC pending frames could not be sent and are dropped,
+ *  with a TX queue they are kept
+ * @return OS_ERROR_TRY_AGAIN the TX queue refuses frames, the network stack
+ *  should hold them back until this returns OS_SUCCESS
+ * @return OS_SUCCESS nothing to do or all frames sent
+ */
+OS_Error_t
+chanmux_nic_driver_rpc_tx_poll(void);
+
 OS_Error_t
 chanmux_nic_driver_rpc_get_mac(void);
+
+/**
+ * @brief set up which frames pass the RX filter, see rx.filter
+ *
+ * A multicast frame passes if the bit for its destination MAC is set in the
+ * hash table. Several groups may share a bit, so the network stack still has
+ * to check the groups it has joined.
+ *
+ * @param flags CHANMUX_NIC_DRV_RX_FILTER_xxx
+ * @param mcast_hash multicast hash table, the bits of all groups joined, see
+ *  chanmux_nic_driver_mcast_hash()
+ *
+ * @return OS_ERROR_NOT_SUPPORTED rx.filter is not enabled
+ * @return OS_SUCCESS filter updated
+ */
+OS_Error_t
+chanmux_nic_driver_rpc_set_rx_filter(
+    uint32_t flags,
+    uint64_t mcast_hash);
+
+/**
+ * @brief get the multicast hash table bit of a MAC
+ *
+ * The bit number is the low 6 bits of the CRC-32 of the MAC, as Ethernet uses
+ * it for the frame check sequence.
+ *
+ * @param mac multicast MAC
+ *
+ * @return hash table with just the bit of the MAC set
+ */
+uint64_t
+chanmux_nic_driver_mcast_hash(
+    const uint8_t *mac);
+
+/**
+ * @brief get a snapshot of the driver statistics
+ *
+ * @param stats receives the counters
+ *
+ * @return OS_ERROR_INVALID_PARAMETER stats is NULL
+ * @return OS_SUCCESS counters copied
+ */
+OS_Error_t
+chanmux_nic_driver_rpc_get_stats(
+    chanmux_nic_drv_stats_t *stats);
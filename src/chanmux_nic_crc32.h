@@ -0,0 +1,48 @@
+/*
+ * ChanMUX Ethernet TAP driver, CRC-32
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 as used by Ethernet (reflected polynomial 0xEDB88320). Start with
+// CHANMUX_NIC_CRC32_INIT, update with each chunk of the data and finish with
+// chanmux_nic_crc32_final().
+#define CHANMUX_NIC_CRC32_INIT  0xFFFFFFFFU
+
+/**
+ * @details update the CRC with a chunk of data
+ *
+ * @param crc CRC of the data so far
+ * @param data chunk of data
+ * @param len length of the chunk
+ *
+ * @retval updated CRC
+ */
+uint32_t
+chanmux_nic_crc32_update(
+    uint32_t crc,
+    const uint8_t *data,
+    size_t len);
+
+/**
+ * @details get the CRC value after all data was added
+ *
+ * @param crc CRC of the data
+ *
+ * @retval CRC value
+ */
+static inline uint32_t
+chanmux_nic_crc32_final(
+    uint32_t crc)
+{
+    return ~crc;
+}
@@ -0,0 +1,347 @@
+/*
+ * ChanMUX Ethernet TAP driver, IP checksums
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "chanmux_nic_csum.h"
+#include "chanmux_nic_drv.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// where the checksummed parts of a TCP or UDP frame are
+typedef struct
+{
+    size_t ip;          // IP header
+    size_t ip_hdr_len;  // IPv4 header length, 0 for IPv6
+    size_t addr;        // source and destination address
+    size_t addr_len;
+    uint8_t proto;
+    size_t l4;          // TCP or UDP header
+    size_t l4_len;      // TCP or UDP header and payload
+    size_t l4_csum;     // TCP or UDP checksum
+} csum_layout_t;
+
+//------------------------------------------------------------------------------
+static inline uint64_t
+csum_add_word(
+    uint64_t sum,
+    uint64_t v)
+{
+    sum += v;
+    return sum + (sum < v);
+}
+
+//------------------------------------------------------------------------------
+// The sum kernel, optionally copying the data. The 32-bit halves of each 64-bit
+// word go into separate accumulators that cannot overflow for any frame size,
+// so there is no carry to take care of per word. The main loop uses the
+// compiler's generic vectors, which map to SIMD registers where the target
+// has them. Data is loaded with __builtin_memcpy(), the compiler turns this
+// into plain, possibly unaligned, loads. Inlining gives a copy and a sum-only
+// variant without the copy check in the loop.
+typedef uint64_t csum_vec_t __attribute__((vector_size(16)));
+
+static inline __attribute__((always_inline)) uint64_t
+csum_kernel(
+    uint8_t *dst,
+    const uint8_t *src,
+    size_t len,
+    uint64_t sum,
+    const bool copy)
+{
+    const csum_vec_t mask = { 0xFFFFFFFF, 0xFFFFFFFF };
+    csum_vec_t lo0 = { 0 };
+    csum_vec_t hi0 = { 0 };
+    csum_vec_t lo1 = { 0 };
+    csum_vec_t hi1 = { 0 };
+
+    while (len >= 2 * sizeof(csum_vec_t))
+    {
+        csum_vec_t v0;
+        csum_vec_t v1;
+        __builtin_memcpy(&v0, src, sizeof(v0));
+        __builtin_memcpy(&v1, &src[sizeof(v0)], sizeof(v1));
+        if (copy)
+        {
+            __builtin_memcpy(dst, &v0, sizeof(v0));
+            __builtin_memcpy(&dst[sizeof(v0)], &v1, sizeof(v1));
+            dst += 2 * sizeof(csum_vec_t);
+        }
+        lo0 += v0 & mask;
+        hi0 += v0 >> 32;
+        lo1 += v1 & mask;
+        hi1 += v1 >> 32;
+        src += 2 * sizeof(csum_vec_t);
+        len -= 2 * sizeof(csum_vec_t);
+    }
+
+    csum_vec_t acc = lo0 + hi0 + lo1 + hi1;
+    uint64_t w;
+    while (len >= sizeof(w))
+    {
+        __builtin_memcpy(&w, src, sizeof(w));
+        if (copy)
+        {
+            __builtin_memcpy(dst, &w, sizeof(w));
+            dst += sizeof(w);
+        }
+        acc[0] += (uint32_t)w;
+        acc[1] += w >> 32;
+        src += sizeof(w);
+        len -= sizeof(w);
+    }
+    if (len > 0)
+    {
+        // the bytes keep their position within the word
+        w = 0;
+        memcpy(&w, src, len);
+        if (copy)
+        {
+            memcpy(dst, &w, len);
+        }
+        acc[0] += (uint32_t)w;
+        acc[1] += w >> 32;
+    }
+
+    sum = csum_add_word(sum, acc[0]);
+    return csum_add_word(sum, acc[1]);
+}
+
+//------------------------------------------------------------------------------
+uint64_t
+chanmux_nic_csum_partial(
+    const void *data,
+    size_t len,
+    uint64_t sum)
+{
+    return csum_kernel(NULL, data, len, sum, false);
+}
+
+//------------------------------------------------------------------------------
+uint64_t
+chanmux_nic_csum_copy(
+    void *dst,
+    const void *src,
+    size_t len,
+    uint64_t sum)
+{
+    return csum_kernel(dst, src, len, sum, true);
+}
+
+//------------------------------------------------------------------------------
+// Find the IP and TCP/UDP headers. Only frames where they follow each other
+// directly qualify, no fragments and no IPv6 extension headers.
+static bool
+csum_get_layout(
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len,
+    csum_layout_t *layout)
+{
+    size_t ip = ETH_HDR_LEN;
+    if (hdr_len < ip)
+    {
+        return false;
+    }
+    uint16_t ethertype = get_be16(&hdr[ip - 2]);
+    if (ETHERTYPE_VLAN == ethertype)
+    {
+        ip += ETH_VLAN_TAG_LEN;
+        if (hdr_len < ip)
+        {
+            return false;
+        }
+        ethertype = get_be16(&hdr[ip - 2]);
+    }
+
+    size_t ip_len;
+    layout->ip = ip;
+    if ((ETHERTYPE_IPV4 == ethertype) && (hdr_len >= ip + 20))
+    {
+        layout->ip_hdr_len = (hdr[ip] & 0x0F) * 4;
+        ip_len = get_be16(&hdr[ip + 2]);
+        if ((0x40 != (hdr[ip] & 0xF0)) || (layout->ip_hdr_len < 20) ||
+            (ip_len < layout->ip_hdr_len) ||
+            (0 != (get_be16(&hdr[ip + 6]) & 0x3FFF)))
+        {
+            return false;
+        }
+        layout->addr = ip + 12;
+        layout->addr_len = 8;
+        layout->proto = hdr[ip + 9];
+        layout->l4 = ip + layout->ip_hdr_len;
+        layout->l4_len = ip_len - layout->ip_hdr_len;
+    }
+    else if ((ETHERTYPE_IPV6 == ethertype) && (hdr_len >= ip + 40))
+    {
+        layout->ip_hdr_len = 0;
+        ip_len = 40 + get_be16(&hdr[ip + 4]);
+        layout->addr = ip + 8;
+        layout->addr_len = 32;
+        layout->proto = hdr[ip + 6];
+        layout->l4 = ip + 40;
+        layout->l4_len = ip_len - 40;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (ip + ip_len > frame_len)
+    {
+        return false;
+    }
+    if (IP_PROTO_TCP == layout->proto)
+    {
+        layout->l4_csum = layout->l4 + 16;
+        if (layout->l4_len < 20)
+        {
+            return false;
+        }
+    }
+    else if (IP_PROTO_UDP == layout->proto)
+    {
+        layout->l4_csum = layout->l4 + 6;
+        if ((layout->l4_len < 8) || (get_be16(&hdr[layout->l4 + 4]) != layout->l4_len))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    // the checksum field must be in the header bytes we have
+    return (layout->l4_csum + 2 <= hdr_len);
+}
+
+//------------------------------------------------------------------------------
+// Get the sum of the TCP or UDP part and the pseudo header from the sum of
+// the whole frame. The Ethernet padding behind the IP packet is taken out
+// also, it must be in the tail bytes. Returns false if it is not.
+static bool
+csum_get_l4_sum(
+    const uint8_t *hdr,
+    const csum_layout_t *layout,
+    size_t frame_len,
+    uint64_t sum,
+    const uint8_t *tail,
+    size_t tail_len,
+    uint64_t *l4_sum)
+{
+    size_t l4_end = layout->l4 + layout->l4_len;
+    size_t pad_len = frame_len - l4_end;
+    if (pad_len > tail_len)
+    {
+        return false;
+    }
+
+    // one's complement subtraction is adding the inverted value
+    uint64_t head = chanmux_nic_csum_partial(hdr, layout->l4, 0);
+    uint64_t pad = chanmux_nic_csum_add(0,
+                                        chanmux_nic_csum_partial(tail - pad_len,
+                                                                 pad_len, 0),
+                                        (l4_end & 1));
+    sum = chanmux_nic_csum_add(sum, (uint16_t)~chanmux_nic_csum_fold(head), false);
+    sum = chanmux_nic_csum_add(sum, (uint16_t)~chanmux_nic_csum_fold(pad), false);
+
+    // pseudo header, the addresses, zero, protocol and the TCP/UDP length
+    uint8_t pseudo[4] = { 0, layout->proto,
+                          (layout->l4_len >> 8) & 0xFF, layout->l4_len & 0xFF
+                        };
+    sum = chanmux_nic_csum_partial(&hdr[layout->addr], layout->addr_len, sum);
+    *l4_sum = chanmux_nic_csum_partial(pseudo, sizeof(pseudo), sum);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_csum_verify(
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len,
+    uint64_t sum,
+    const uint8_t *tail,
+    size_t tail_len)
+{
+    csum_layout_t layout;
+    if (!csum_get_layout(hdr, hdr_len, frame_len, &layout))
+    {
+        return false;
+    }
+
+    if ((layout.ip_hdr_len > 0) &&
+        (0xFFFF != chanmux_nic_csum_fold(
+             chanmux_nic_csum_partial(&hdr[layout.ip], layout.ip_hdr_len, 0))))
+    {
+        return false;
+    }
+
+    // UDP over IPv4 may go without checksum
+    if ((IP_PROTO_UDP == layout.proto) && (layout.ip_hdr_len > 0) &&
+        (0 == get_be16(&hdr[layout.l4_csum])))
+    {
+        return true;
+    }
+
+    uint64_t l4_sum;
+    if (!csum_get_l4_sum(hdr, &layout, frame_len, sum, tail, tail_len, &l4_sum))
+    {
+        return false;
+    }
+
+    return (0xFFFF == chanmux_nic_csum_fold(l4_sum));
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_csum_fill(
+    uint8_t *frame,
+    size_t len,
+    uint64_t sum)
+{
+    csum_layout_t layout;
+    if (!csum_get_layout(frame, len, len, &layout))
+    {
+        return false;
+    }
+
+    // the TCP/UDP sum is taken out of the frame sum first, it does not match
+    // the frame any more once the IP header checksum is set
+    uint64_t l4_sum;
+    bool isL4Blank = (0 == get_be16(&frame[layout.l4_csum])) &&
+                     csum_get_l4_sum(frame, &layout, len, sum, &frame[len], len,
+                                     &l4_sum);
+
+    bool isFilled = false;
+    if ((layout.ip_hdr_len > 0) && (0 == get_be16(&frame[layout.ip + 10])))
+    {
+        uint16_t csum = ~chanmux_nic_csum_fold(
+                            chanmux_nic_csum_partial(&frame[layout.ip],
+                                                     layout.ip_hdr_len, 0));
+        memcpy(&frame[layout.ip + 10], &csum, sizeof(csum));
+        isFilled = true;
+    }
+
+    if (isL4Blank)
+    {
+        uint16_t csum = ~chanmux_nic_csum_fold(l4_sum);
+        // zero means no checksum for UDP, its inverted value is sent instead
+        if ((IP_PROTO_UDP == layout.proto) && (0 == csum))
+        {
+            csum = 0xFFFF;
+        }
+        memcpy(&frame[layout.l4_csum], &csum, sizeof(csum));
+        isFilled = true;
+    }
+
+    return isFilled;
+}
@@ -0,0 +1,138 @@
+/*
+ * ChanMUX Ethernet TAP driver, IP checksums
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Internet checksum (RFC 1071). The partial sums here are the one's complement
+// sum of the data taken as 16-bit words in host byte order. Folded, this is
+// the checksum in host byte order of the bytes in memory, so it can be stored
+// as it is. A chunk is assumed to start at an even offset of the data it is
+// part of, chanmux_nic_csum_add() handles chunks at an odd offset.
+
+/**
+ * @details add a chunk of data to a partial sum
+ *
+ * @param data chunk of data
+ * @param len length of the chunk
+ * @param sum partial sum of the data so far
+ *
+ * @retval updated partial sum
+ */
+uint64_t
+chanmux_nic_csum_partial(
+    const void *data,
+    size_t len,
+    uint64_t sum);
+
+/**
+ * @details copy a chunk of data and add it to a partial sum in the same pass
+ *
+ * @param dst destination, must not overlap with src
+ * @param src chunk of data
+ * @param len length of the chunk
+ * @param sum partial sum of the data so far
+ *
+ * @retval updated partial sum
+ */
+uint64_t
+chanmux_nic_csum_copy(
+    void *dst,
+    const void *src,
+    size_t len,
+    uint64_t sum);
+
+/**
+ * @details fold a partial sum to 16 bit
+ *
+ * @param sum partial sum
+ *
+ * @retval one's complement sum, the checksum is the inverted value
+ */
+static inline uint16_t
+chanmux_nic_csum_fold(
+    uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+/**
+ * @details add the partial sum of a chunk to the sum of the data in front of
+ *  it
+ *
+ * @param sum partial sum of the data in front of the chunk
+ * @param part partial sum of the chunk
+ * @param odd the chunk starts at an odd offset
+ *
+ * @retval updated partial sum
+ */
+static inline uint64_t
+chanmux_nic_csum_add(
+    uint64_t sum,
+    uint64_t part,
+    bool odd)
+{
+    if (odd)
+    {
+        // the bytes of each 16-bit word are swapped for such a chunk
+        uint16_t f = chanmux_nic_csum_fold(part);
+        part = (uint16_t)((f << 8) | (f >> 8));
+    }
+    sum += part;
+    return sum + (sum < part);
+}
+
+/**
+ * @details check the IPv4 header and the TCP or UDP checksum of a received
+ *  frame
+ *
+ * @param hdr start of the frame, with at least the Ethernet, IP and TCP or
+ *  UDP header
+ * @param hdr_len bytes at hdr
+ * @param frame_len length of the frame
+ * @param sum partial sum of the whole frame
+ * @param tail end of the frame, it has the Ethernet padding behind the IP
+ *  packet
+ * @param tail_len bytes in front of tail that belong to the frame
+ *
+ * @retval true if the frame is IPv4 or IPv6 with TCP or UDP and all checksums
+ *  are correct. A UDP datagram without checksum passes.
+ */
+bool
+chanmux_nic_csum_verify(
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len,
+    uint64_t sum,
+    const uint8_t *tail,
+    size_t tail_len);
+
+/**
+ * @details fill in the IPv4 header and the TCP or UDP checksum of a frame to
+ *  send, if they are zero
+ *
+ * @param frame the frame
+ * @param len length of the frame
+ * @param sum partial sum of the frame
+ *
+ * @retval true if a checksum was filled in
+ */
+bool
+chanmux_nic_csum_fill(
+    uint8_t *frame,
+    size_t len,
+    uint64_t sum);
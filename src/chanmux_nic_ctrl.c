@@ -15,6 +15,7 @@
 #include "ChanMuxNic.h"
 #include "chanmux_nic_drv.h"
 #include "chanmux_nic_drv_api.h"
+#include <sel4/sel4.h> // needed for seL4_Yield()
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
@@ -58,83 +59,578 @@ chanmux_ctrl_write(
     return OS_SUCCESS;
 }
 
+enum
+{
+    CTRL_REQ_FREE = 0,
+    CTRL_REQ_PENDING,   // command sent, waiting for the response
+    CTRL_REQ_DONE,      // response complete
+    CTRL_REQ_FAILED,    // response lost, channel error
+    CTRL_REQ_ABANDONED  // timed out, the response is dropped when it arrives
+};
+
 //------------------------------------------------------------------------------
-// read response from control channel. There is no point in returning the read
-// length as full responses must be read or there is an error
-static OS_Error_t
-chanmux_ctrl_readBlocking(
-    const ChanMux_ChannelOpsCtx_t *ctrl_channel,
-    void *buf,
+// get the deadline for a command sent now, 0 if there is none
+static uint64_t
+ctrl_get_deadline(
+    const chanmux_nic_drv_t *ctx)
+{
+    uint64_t timeout_ns = get_ctrl_timeout_ns(ctx);
+    uint64_t now_ns;
+    if ((0 == timeout_ns) || !get_time_ns(ctx, &now_ns))
+    {
+        return 0;
+    }
+
+    return now_ns + timeout_ns;
+}
+
+//------------------------------------------------------------------------------
+// check if a deadline has expired, otherwise get the time left
+static bool
+ctrl_is_expired(
+    const chanmux_nic_drv_t *ctx,
+    uint64_t deadline_ns,
+    uint64_t *left_ns)
+{
+    uint64_t now_ns;
+    *left_ns = 0;
+    if ((0 == deadline_ns) || !get_time_ns(ctx, &now_ns))
+    {
+        return false;
+    }
+    if (now_ns >= deadline_ns)
+    {
+        return true;
+    }
+
+    *left_ns = deadline_ns - now_ns;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// find the request that the next response belongs to, the caller must hold
+// the mutex
+static unsigned int
+ctrl_find_next_response(
+    const chanmux_nic_drv_t *ctx)
+{
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_CTRL_MAX_PENDING; i++)
+    {
+        if (((CTRL_REQ_PENDING == ctx->ctrl.req[i].state) ||
+             (CTRL_REQ_ABANDONED == ctx->ctrl.req[i].state)) &&
+            (ctx->ctrl.req[i].seq == ctx->ctrl.rsp_seq))
+        {
+            return i;
+        }
+    }
+
+    return CHANMUX_NIC_DRV_CTRL_MAX_PENDING;
+}
+
+//------------------------------------------------------------------------------
+// Assign received data to the pending requests in the order the commands were
+// sent. The caller must hold the mutex.
+static void
+ctrl_dispatch(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *data,
     size_t len)
 {
-    size_t port_size;
+    while (len > 0)
+    {
+        unsigned int tag = ctrl_find_next_response(ctx);
+        if (tag >= CHANMUX_NIC_DRV_CTRL_MAX_PENDING)
+        {
+            Debug_LOG_WARNING("drop %zu bytes without pending request", len);
+            return;
+        }
 
-    port_size = OS_Dataport_getSize(ctrl_channel->port.read);
-    if (len > port_size)
+        chanmux_nic_drv_ctrl_req_t *req = &ctx->ctrl.req[tag];
+        size_t chunk = req->rsp_len - req->rsp_received;
+        if (req->status_first && (req->rsp_received < 2))
+        {
+            chunk = 2 - req->rsp_received;
+        }
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(&req->rsp[req->rsp_received], data, chunk);
+        req->rsp_received += chunk;
+        data = &data[chunk];
+        len -= chunk;
+
+        // nothing follows an error status
+        if (req->status_first && (2 == req->rsp_received) &&
+            ((CHANMUX_NIC_RSP_GET_CAPS != req->rsp[0]) || (0 != req->rsp[1])))
+        {
+            req->rsp_received = req->rsp_len;
+        }
+
+        if (req->rsp_received == req->rsp_len)
+        {
+            // nobody waits for the response of an abandoned request
+            req->state = (CTRL_REQ_ABANDONED == req->state) ? CTRL_REQ_FREE
+                         : CTRL_REQ_DONE;
+            ctx->ctrl.rsp_seq++;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Check if the peer has lost the responses of timed out commands. That is
+// assumed if no other command is in flight and the last one timed out at least
+// a timeout ago. The caller must hold the mutex.
+static bool
+ctrl_is_lost(
+    const chanmux_nic_drv_t *ctx)
+{
+    uint64_t last_ns = 0;
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_CTRL_MAX_PENDING; i++)
     {
-        Debug_LOG_ERROR("len (%zu) exceeds buffer size (%zu)", len, port_size);
+        const chanmux_nic_drv_ctrl_req_t *req = &ctx->ctrl.req[i];
+        if (CTRL_REQ_FREE == req->state)
+        {
+            continue;
+        }
+        if (CTRL_REQ_ABANDONED != req->state)
+        {
+            return false;
+        }
+        if (req->deadline_ns > last_ns)
+        {
+            last_ns = req->deadline_ns;
+        }
+    }
+
+    uint64_t left_ns;
+    return (last_ns > 0) &&
+           ctrl_is_expired(ctx, last_ns + get_ctrl_timeout_ns(ctx), &left_ns);
+}
+
+//------------------------------------------------------------------------------
+// The channel is out of sync, all requests in flight fail. The caller must
+// hold the mutex.
+static void
+ctrl_fail_pending(
+    chanmux_nic_drv_t *ctx)
+{
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_CTRL_MAX_PENDING; i++)
+    {
+        if (CTRL_REQ_PENDING == ctx->ctrl.req[i].state)
+        {
+            ctx->ctrl.req[i].state = CTRL_REQ_FAILED;
+        }
+        else if (CTRL_REQ_ABANDONED == ctx->ctrl.req[i].state)
+        {
+            ctx->ctrl.req[i].state = CTRL_REQ_FREE;
+        }
+    }
+    ctx->ctrl.rsp_seq = ctx->ctrl.req_seq;
+}
+
+//------------------------------------------------------------------------------
+// Get how long the reader may block, until the earliest deadline of the given
+// one, those of the pending requests and those of the waiting callers, 0 if
+// there is none. Expired requests are left to their callers. The caller must
+// hold the mutex.
+static uint64_t
+ctrl_get_wait_ns(
+    const chanmux_nic_drv_t *ctx,
+    uint64_t deadline_ns)
+{
+    uint64_t wait_ns = 0;
+    uint64_t left_ns;
+    if (!ctrl_is_expired(ctx, deadline_ns, &left_ns))
+    {
+        wait_ns = left_ns;
+    }
+    if (!ctrl_is_expired(ctx, ctx->ctrl.waiter_deadline_ns, &left_ns) &&
+        (left_ns > 0) && ((0 == wait_ns) || (left_ns < wait_ns)))
+    {
+        wait_ns = left_ns;
+    }
+
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_CTRL_MAX_PENDING; i++)
+    {
+        const chanmux_nic_drv_ctrl_req_t *req = &ctx->ctrl.req[i];
+        if ((CTRL_REQ_PENDING == req->state) &&
+            !ctrl_is_expired(ctx, req->deadline_ns, &left_ns) &&
+            (left_ns > 0) && ((0 == wait_ns) || (left_ns < wait_ns)))
+        {
+            wait_ns = left_ns;
+        }
+    }
+
+    return wait_ns;
+}
+
+//------------------------------------------------------------------------------
+// Wake the callers waiting for the reader, they check their requests again and
+// one of them may take over the reader role. The caller must hold the mutex.
+static void
+ctrl_wake_waiters(
+    chanmux_nic_drv_t *ctx)
+{
+    if (0 == ctx->ctrl.waiters)
+    {
+        return;
+    }
+
+    while (ctx->ctrl.waiters > 0)
+    {
+        ctx->ctrl.waiters--;
+        chanmux_channel_ctrl_rsp_notify(ctx);
+    }
+    ctx->ctrl.waiter_deadline_ns = 0;
+    ctx->ctrl.wake_gen++;
+}
+
+//------------------------------------------------------------------------------
+// Read what the control channel has and dispatch it. The caller must hold the
+// mutex, so commands are not written while the response is in the dataport,
+// which may be shared for reading and writing.
+static OS_Error_t
+ctrl_read(
+    chanmux_nic_drv_t *ctx,
+    size_t *len)
+{
+    const ChanMux_ChannelOpsCtx_t *ctrl_channel = get_chanmux_channel_ctrl(ctx);
+
+    // this is a non-blocking read
+    *len = 0;
+    OS_Error_t err = ctrl_channel->func.read(
+                         ctrl_channel->id,
+                         OS_Dataport_getSize(ctrl_channel->port.read),
+                         len);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("ChanMux_read() failed, error %d", err);
         return OS_ERROR_GENERIC;
     }
 
-    uint8_t *buffer = (uint8_t *)buf;
-    size_t lenRemaining = len;
+    // this copies the responses out of the dataport
+    ctrl_dispatch(ctx, OS_Dataport_getBuf(ctrl_channel->port.read), *len);
+    return OS_SUCCESS;
+}
 
-    // we are a graceful receiver and allow a response in multiple chunks.
-    while (lenRemaining > 0)
+//------------------------------------------------------------------------------
+// Drop everything the control channel has, so a late part of a response is
+// not taken as a response to the next command. The caller must hold the mutex.
+static void
+ctrl_drain(
+    chanmux_nic_drv_t *ctx)
+{
+    const ChanMux_ChannelOpsCtx_t *ctrl_channel = get_chanmux_channel_ctrl(ctx);
+    size_t dropped = 0;
+    size_t len;
+
+    do
     {
-        chanmux_channel_ctrl_wait();
+        len = 0;
+        OS_Error_t err = ctrl_channel->func.read(
+                             ctrl_channel->id,
+                             OS_Dataport_getSize(ctrl_channel->port.read),
+                             &len);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("ChanMux_read() failed, error %d", err);
+            break;
+        }
+        dropped += len;
+    }
+    while (len > 0);
 
-        size_t chunk_read = 0;
-        do
+    if (dropped > 0)
+    {
+        Debug_LOG_WARNING("dropped %zu bytes of late responses", dropped);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Wait until responses have been dispatched or a request was released, but not
+// beyond deadline_ns if that is not 0. The caller must hold the mutex, this
+// releases it. If a response is expected and nobody else reads the channel,
+// the caller takes the reader role. It reads under the mutex, but blocks on
+// the channel event without it, so other callers can send commands meanwhile.
+// Otherwise it waits until the reader or a caller releasing a request wakes it.
+static OS_Error_t
+ctrl_wait_rsp(
+    chanmux_nic_drv_t *ctx,
+    uint64_t deadline_ns)
+{
+    if (ctx->ctrl.reader_active ||
+        (ctrl_find_next_response(ctx) >= CHANMUX_NIC_DRV_CTRL_MAX_PENDING))
+    {
+        // the reader wakes up for the earliest deadline of the waiters
+        if ((0 != deadline_ns) && ((0 == ctx->ctrl.waiter_deadline_ns) ||
+                                   (deadline_ns < ctx->ctrl.waiter_deadline_ns)))
         {
-            // this is a non-blocking read, so we are effectively polling here if
-            // the response is not recevied in one chunk. That is bad actually if
-            // we ever really have chunked data - so far this luckily never
-            // happens ...
-            OS_Error_t err = ctrl_channel->func.read(
-                ctrl_channel->id,
-                lenRemaining,
-                &chunk_read);
-            if (err != OS_SUCCESS)
-            {
-                Debug_LOG_ERROR("ChanMux_read() failed, error %d", err);
-                return OS_ERROR_GENERIC;
-            }
+            ctx->ctrl.waiter_deadline_ns = deadline_ns;
+        }
+        uint32_t wake_gen = ctx->ctrl.wake_gen;
+        ctx->ctrl.waiters++;
+        (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+        if (!chanmux_channel_ctrl_rsp_wait(ctx))
+        {
+            seL4_Yield();
+            return OS_SUCCESS;
+        }
 
-            assert(chunk_read <= lenRemaining);
+        OS_Error_t err = chanmux_channel_ctrl_mutex_lock(ctx);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Failure getting lock, returned %d", err);
+            return OS_ERROR_GENERIC;
+        }
+        // Nobody was woken since this caller started waiting, so it took the
+        // post of a caller woken before that did not get to wait yet. A reader
+        // wakes that one later, otherwise pass the post on.
+        if ((wake_gen == ctx->ctrl.wake_gen) && !ctx->ctrl.reader_active &&
+            (ctrl_find_next_response(ctx) >= CHANMUX_NIC_DRV_CTRL_MAX_PENDING))
+        {
+            ctx->ctrl.waiters--;
+            chanmux_channel_ctrl_rsp_notify(ctx);
+        }
+        (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+        return OS_SUCCESS;
+    }
 
-            if (chunk_read > 0)
-            {
-                memcpy(buffer, OS_Dataport_getBuf(ctrl_channel->port.read),
-                       chunk_read);
+    // a response may have arrived while another caller was reading
+    size_t len;
+    OS_Error_t err = ctrl_read(ctx, &len);
+    if ((OS_SUCCESS == err) && (0 == len))
+    {
+        ctx->ctrl.reader_active = true;
+        uint64_t wait_ns = ctrl_get_wait_ns(ctx, deadline_ns);
+        (void)chanmux_channel_ctrl_mutex_unlock(ctx);
 
-                buffer = &buffer[chunk_read];
-                lenRemaining -= chunk_read;
-            }
-        } while (chunk_read > 0);
+        chanmux_channel_ctrl_wait_timeout(ctx, wait_ns);
+
+        err = chanmux_channel_ctrl_mutex_lock(ctx);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Failure getting lock, returned %d", err);
+            ctx->ctrl.reader_active = false;
+            return OS_ERROR_GENERIC;
+        }
+        ctx->ctrl.reader_active = false;
+        err = ctrl_read(ctx, &len);
     }
+    if (err != OS_SUCCESS)
+    {
+        ctrl_fail_pending(ctx);
+    }
+
+    ctrl_wake_waiters(ctx);
+    (void)chanmux_channel_ctrl_mutex_unlock(ctx);
     return OS_SUCCESS;
 }
 
 //------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_ctrl_submit(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *cmd,
+    size_t cmd_len,
+    size_t rsp_len,
+    unsigned int *tag)
+{
+    if (rsp_len > CHANMUX_NIC_DRV_CTRL_RSP_MAX)
+    {
+        Debug_LOG_ERROR("response len %zu exceeds max %d",
+                        rsp_len, CHANMUX_NIC_DRV_CTRL_RSP_MAX);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t ret = chanmux_channel_ctrl_mutex_lock(ctx);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Failure getting lock, returned %d", ret);
+        return OS_ERROR_GENERIC;
+    }
+
+    // Requests of timed out commands are occupied until their response
+    // arrives. If it does not come, all commands would fail from now on.
+    if (ctrl_is_lost(ctx))
+    {
+        Debug_LOG_WARNING("responses of timed out commands lost, resync");
+        ctrl_drain(ctx);
+        ctrl_fail_pending(ctx);
+    }
+
+    unsigned int i = 0;
+    while ((i < CHANMUX_NIC_DRV_CTRL_MAX_PENDING) &&
+           (CTRL_REQ_FREE != ctx->ctrl.req[i].state))
+    {
+        i++;
+    }
+
+    if (i >= CHANMUX_NIC_DRV_CTRL_MAX_PENDING)
+    {
+        ret = OS_ERROR_TRY_AGAIN;
+    }
+    else
+    {
+        // sending the command under the mutex keeps the sequence numbers in
+        // the order the peer sees the commands.
+        ret = chanmux_ctrl_write(get_chanmux_channel_ctrl(ctx), cmd, cmd_len);
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Writing command for %d returned error %d",
+                            cmd[0], ret);
+        }
+        else
+        {
+            chanmux_nic_drv_ctrl_req_t *req = &ctx->ctrl.req[i];
+            req->state = CTRL_REQ_PENDING;
+            req->seq = ctx->ctrl.req_seq++;
+            req->deadline_ns = ctrl_get_deadline(ctx);
+            req->rsp_len = rsp_len;
+            req->rsp_received = 0;
+            // a peer that does not know the protocol extension answers with
+            // the 2 byte status only
+            req->status_first = (CHANMUX_NIC_CMD_GET_CAPS == cmd[0]);
+            *tag = i;
+        }
+    }
+
+    OS_Error_t ret_mux = chanmux_channel_ctrl_mutex_unlock(ctx);
+    if (ret_mux != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Failure releasing lock, returned %d", ret_mux);
+    }
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_ctrl_wait_reply(
+    chanmux_nic_drv_t *ctx,
+    unsigned int tag,
+    uint8_t *rsp,
+    size_t rsp_len)
+{
+    if ((tag >= CHANMUX_NIC_DRV_CTRL_MAX_PENDING) ||
+        (rsp_len != ctx->ctrl.req[tag].rsp_len))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (;;)
+    {
+        OS_Error_t ret = chanmux_channel_ctrl_mutex_lock(ctx);
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Failure getting lock, returned %d", ret);
+            return OS_ERROR_GENERIC;
+        }
+
+        chanmux_nic_drv_ctrl_req_t *req = &ctx->ctrl.req[tag];
+        uint8_t state = req->state;
+        if (CTRL_REQ_PENDING != state)
+        {
+            memcpy(rsp, req->rsp, rsp_len);
+            req->state = CTRL_REQ_FREE;
+            // a caller may wait for a free request
+            ctrl_wake_waiters(ctx);
+            (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+            return (CTRL_REQ_DONE == state) ? OS_SUCCESS : OS_ERROR_GENERIC;
+        }
+
+        uint64_t left_ns;
+        if (ctrl_is_expired(ctx, req->deadline_ns, &left_ns))
+        {
+            req->state = CTRL_REQ_ABANDONED;
+            ctx->stats->ctrl_timeouts++;
+            // nobody may read for the others now
+            ctrl_wake_waiters(ctx);
+            (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+            Debug_LOG_ERROR("no response within %llu ns",
+                            (unsigned long long)get_ctrl_timeout_ns(ctx));
+            return OS_ERROR_TIMEOUT;
+        }
+
+        // one caller reads the responses for all, the others wait for it
+        if (ctrl_wait_rsp(ctx, req->deadline_ns) != OS_SUCCESS)
+        {
+            return OS_ERROR_GENERIC;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// send a command, wait if too many commands are in flight. Requests of timed
+// out commands are occupied until their response arrives, so this reads the
+// responses meanwhile, but waits not longer than the timeout either.
+static OS_Error_t
+ctrl_send(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *cmd,
+    size_t cmd_len,
+    size_t rsp_len,
+    unsigned int *tag)
+{
+    OS_Error_t ret;
+    uint64_t deadline_ns = ctrl_get_deadline(ctx);
+    uint64_t left_ns;
+
+    while (OS_ERROR_TRY_AGAIN == (ret = chanmux_nic_ctrl_submit(
+                                            ctx, cmd, cmd_len, rsp_len, tag)))
+    {
+        ret = chanmux_channel_ctrl_mutex_lock(ctx);
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Failure getting lock, returned %d", ret);
+            return OS_ERROR_GENERIC;
+        }
+
+        if (ctrl_is_expired(ctx, deadline_ns, &left_ns))
+        {
+            // chanmux_nic_ctrl_submit() resyncs the channel if the responses
+            // of the timed out commands are lost
+            if (ctrl_is_lost(ctx))
+            {
+                (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+                continue;
+            }
+            (void)chanmux_channel_ctrl_mutex_unlock(ctx);
+            Debug_LOG_ERROR("no free request for command %d", cmd[0]);
+            return OS_ERROR_TIMEOUT;
+        }
+
+        // If no response is expected, the requests are complete and this
+        // waits until their callers have released one.
+        if (ctrl_wait_rsp(ctx, deadline_ns) != OS_SUCCESS)
+        {
+            return OS_ERROR_GENERIC;
+        }
+    }
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// send a command and wait for the response. Other commands can be sent
+// before it arrives, see chanmux_nic_ctrl_wait_reply().
 static OS_Error_t
-chanmux_nic_channel_ctrl_request_reply(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
+chanmux_nic_channel_ctrl_cmd(
+    chanmux_nic_drv_t *ctx,
     uint8_t *cmd,
     size_t cmd_len,
     uint8_t *rsp,
     size_t rsp_len)
 {
-    OS_Error_t ret;
+    unsigned int tag;
 
-    ret = chanmux_ctrl_write(channel_ctrl, cmd, cmd_len);
+    OS_Error_t ret = ctrl_send(ctx, cmd, cmd_len, rsp_len, &tag);
     if (ret != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("Writing command for %d returned error %d", cmd[0], ret);
         return ret;
     }
 
-    ret = chanmux_ctrl_readBlocking(channel_ctrl, rsp, rsp_len);
+    ret = chanmux_nic_ctrl_wait_reply(ctx, tag, rsp, rsp_len);
     if (ret != OS_SUCCESS)
     {
         Debug_LOG_ERROR("Reading response for %d returned error %d", cmd[0], ret);
@@ -146,84 +642,205 @@ chanmux_nic_channel_ctrl_request_reply(
 
 //------------------------------------------------------------------------------
 static OS_Error_t
-chanmux_nic_channel_ctrl_cmd(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    uint8_t *cmd,
-    size_t cmd_len,
-    uint8_t *rsp,
-    size_t rsp_len)
+ctrl_check_get_mac_rsp(
+    const uint8_t *rsp)
 {
-    OS_Error_t ret_mux;
-
-    ret_mux = chanmux_channel_ctrl_mutex_lock();
-    if (ret_mux != OS_SUCCESS)
+    uint8_t rsp_result = rsp[0];
+    if (rsp_result != CHANMUX_NIC_RSP_GET_MAC)
     {
-        Debug_LOG_ERROR("Failure getting lock, returned %d", ret_mux);
+        Debug_LOG_ERROR("command GETMAC failed, status code %u", rsp_result);
+        return OS_ERROR_GENERIC;
+    }
+    uint8_t rsp_ctx = rsp[1];
+    if (rsp_ctx != 0)
+    {
+        Debug_LOG_ERROR("command GETMAC response ctx error, found %u", rsp_ctx);
         return OS_ERROR_GENERIC;
     }
 
-    OS_Error_t ret = chanmux_nic_channel_ctrl_request_reply(
-        channel_ctrl,
-        cmd,
-        cmd_len,
-        rsp,
-        rsp_len);
+    return OS_SUCCESS;
+}
 
-    // we have to release the mutex even if the command failed
-    ret_mux = chanmux_channel_ctrl_mutex_unlock();
-    if (ret_mux != OS_SUCCESS)
+//------------------------------------------------------------------------------
+// cache the MAC, an all zero MAC is not valid
+static void
+ctrl_cache_mac(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *mac)
+{
+    const uint8_t empty_mac[MAC_SIZE] = {0};
+    if (memcmp(mac, empty_mac, MAC_SIZE) == 0)
     {
-        Debug_LOG_ERROR("Failure releasing lock, returned %d", ret_mux);
+        return;
     }
 
-    return ret;
+    memcpy(ctx->caps.mac, mac, MAC_SIZE);
+    ctx->caps.mac_valid = true;
 }
 
 //------------------------------------------------------------------------------
-OS_Error_t
-chanmux_nic_channel_open(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data)
+static void
+ctrl_parse_caps(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *rsp)
 {
-    OS_Error_t ret;
+    if ((rsp[0] != CHANMUX_NIC_RSP_GET_CAPS) || (rsp[1] != 0))
+    {
+        Debug_LOG_WARNING("command GET_CAPS failed, status code %u, using "
+                          "defaults", rsp[0]);
+        return;
+    }
 
-    uint8_t cmd[2] = {CHANMUX_NIC_CMD_OPEN, chan_id_data};
+    uint16_t max_frame_len = (rsp[4] << 8) | rsp[5];
+    uint16_t features = (rsp[6] << 8) | rsp[7];
+    uint16_t offloads = (rsp[8] << 8) | rsp[9];
+
+    ctx->caps.max_batch_frames = rsp[3];
+    if (0 != max_frame_len)
+    {
+        ctx->caps.max_frame_len = max_frame_len;
+    }
+    // use only what both sides support
+    ctx->caps.features = features & CHANMUX_NIC_DRV_FEATURES_SUPPORTED;
+    ctx->caps.offloads = offloads & CHANMUX_NIC_DRV_OFFLOADS_SUPPORTED;
+
+    Debug_LOG_INFO("link caps version %u: max frame len %u, max batch %u, "
+                   "features 0x%04x/0x%04x, offloads 0x%04x/0x%04x",
+                   rsp[2], ctx->caps.max_frame_len, ctx->caps.max_batch_frames,
+                   ctx->caps.features, features, ctx->caps.offloads, offloads);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+ctrl_set_features(
+    chanmux_nic_drv_t *ctx,
+    uint16_t features)
+{
+    OS_Error_t ret;
+    unsigned int chan_id_data = get_chanmux_channel_data(ctx)->id;
+    uint8_t cmd[4] = {CHANMUX_NIC_CMD_SET_FEATURES, chan_id_data,
+                      (features >> 8) & 0xFF, features & 0xFF
+                     };
+    // 2 byte response
     uint8_t rsp[2];
     ret = chanmux_nic_channel_ctrl_cmd(
-        channel_ctrl,
+        ctx,
         cmd,
         sizeof(cmd),
         rsp,
         sizeof(rsp));
     if (ret != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("Sending OPEN returned error %d", ret);
-        return OS_ERROR_GENERIC;
+        Debug_LOG_ERROR("Sending SET_FEATURES returned error %d", ret);
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
     }
-    uint8_t rsp_result = rsp[0];
-    if (rsp_result != CHANMUX_NIC_RSP_OPEN)
+    if ((rsp[0] != CHANMUX_NIC_RSP_SET_FEATURES) || (rsp[1] != 0))
     {
-        Debug_LOG_ERROR("command OPEN failed, status code %u", rsp_result);
+        Debug_LOG_ERROR("command SET_FEATURES failed, status code %u", rsp[0]);
         return OS_ERROR_GENERIC;
     }
 
     return OS_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_channel_open(
+    chanmux_nic_drv_t *ctx)
+{
+    OS_Error_t ret;
+    unsigned int chan_id_data = get_chanmux_channel_data(ctx)->id;
+
+    // defaults for a peer that knows the plain protocol only. The 2-byte
+    // length prefix limits the frame length.
+    memset(&ctx->caps, 0, sizeof(ctx->caps));
+    ctx->caps.max_frame_len = 0xFFFF;
+
+    // the commands are pipelined, the peer processes them in order, so the
+    // queries see the opened channel.
+    uint8_t cmd[2] = {CHANMUX_NIC_CMD_OPEN, chan_id_data};
+    uint8_t rsp[2];
+    unsigned int tag_open;
+    ret = ctrl_send(ctx, cmd, sizeof(cmd), sizeof(rsp), &tag_open);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Sending OPEN returned error %d", ret);
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
+    }
+
+    uint8_t cmd_mac[2] = {CHANMUX_NIC_CMD_GET_MAC, chan_id_data};
+    // 8 byte response (2 byte status and 6 byte MAC)
+    uint8_t rsp_mac[8];
+    unsigned int tag_mac;
+    bool mac_sent = (OS_SUCCESS == ctrl_send(ctx, cmd_mac, sizeof(cmd_mac),
+                                              sizeof(rsp_mac), &tag_mac));
+
+    uint8_t cmd_caps[2] = {CHANMUX_NIC_CMD_GET_CAPS, chan_id_data};
+    uint8_t rsp_caps[CHANMUX_NIC_GET_CAPS_RSP_LEN];
+    unsigned int tag_caps;
+    bool caps_sent = is_ctrl_get_caps_enabled(ctx) &&
+                     (OS_SUCCESS == ctrl_send(ctx, cmd_caps, sizeof(cmd_caps),
+                                              sizeof(rsp_caps), &tag_caps));
+
+    // collect all responses, even if one fails, to release the requests
+    ret = chanmux_nic_ctrl_wait_reply(ctx, tag_open, rsp, sizeof(rsp));
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Reading OPEN response returned error %d", ret);
+    }
+    else if (rsp[0] != CHANMUX_NIC_RSP_OPEN)
+    {
+        Debug_LOG_ERROR("command OPEN failed, status code %u", rsp[0]);
+        ret = OS_ERROR_GENERIC;
+    }
+
+    if (mac_sent &&
+        (OS_SUCCESS == chanmux_nic_ctrl_wait_reply(ctx, tag_mac, rsp_mac,
+                                                   sizeof(rsp_mac))) &&
+        (OS_SUCCESS == ctrl_check_get_mac_rsp(rsp_mac)))
+    {
+        ctrl_cache_mac(ctx, &rsp_mac[2]);
+    }
+
+    if (caps_sent &&
+        (OS_SUCCESS == chanmux_nic_ctrl_wait_reply(ctx, tag_caps, rsp_caps,
+                                                   sizeof(rsp_caps))))
+    {
+        ctrl_parse_caps(ctx, rsp_caps);
+    }
+
+    if (OS_SUCCESS != ret)
+    {
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
+    }
+
+    // the peer uses the features only after we have enabled them. The data
+    // channel is not started yet, so the framing can't change on the fly.
+    if ((0 != ctx->caps.features) &&
+        (OS_SUCCESS != ctrl_set_features(ctx, ctx->caps.features)))
+    {
+        Debug_LOG_WARNING("enabling features 0x%04x failed, using none",
+                          ctx->caps.features);
+        ctx->caps.features = 0;
+    }
+
+    return OS_SUCCESS;
+}
+
 //------------------------------------------------------------------------------
 OS_Error_t
 chanmux_nic_ctrl_get_mac(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data,
+    chanmux_nic_drv_t *ctx,
     uint8_t *mac)
 {
     OS_Error_t ret;
+    unsigned int chan_id_data = get_chanmux_channel_data(ctx)->id;
 
     uint8_t cmd[2] = {CHANMUX_NIC_CMD_GET_MAC, chan_id_data};
     // 8 byte response (2 byte status and 6 byte MAC)
     uint8_t rsp[8];
     ret = chanmux_nic_channel_ctrl_cmd(
-        channel_ctrl,
+        ctx,
         cmd,
         sizeof(cmd),
         rsp,
@@ -231,22 +848,16 @@ chanmux_nic_ctrl_get_mac(
     if (ret != OS_SUCCESS)
     {
         Debug_LOG_ERROR("Sending GET_MAC returned error %d", ret);
-        return OS_ERROR_GENERIC;
-    }
-    uint8_t rsp_result = rsp[0];
-    if (rsp_result != CHANMUX_NIC_RSP_GET_MAC)
-    {
-        Debug_LOG_ERROR("command GETMAC failed, status code %u", rsp_result);
-        return OS_ERROR_GENERIC;
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
     }
-    uint8_t rsp_ctx = rsp[1];
-    if (rsp_ctx != 0)
+    ret = ctrl_check_get_mac_rsp(rsp);
+    if (ret != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("command GETMAC response ctx error, found %u", rsp_ctx);
-        return OS_ERROR_GENERIC;
+        return ret;
     }
 
     memcpy(mac, &rsp[2], MAC_SIZE);
+    ctrl_cache_mac(ctx, mac);
 
     return OS_SUCCESS;
 }
@@ -254,22 +865,22 @@ chanmux_nic_ctrl_get_mac(
 //------------------------------------------------------------------------------
 OS_Error_t
 chanmux_nic_ctrl_stopData(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data)
+    chanmux_nic_drv_t *ctx)
 {
     OS_Error_t ret;
+    unsigned int chan_id_data = get_chanmux_channel_data(ctx)->id;
     uint8_t cmd[2] = {CHANMUX_NIC_CMD_STOP_READ, chan_id_data};
     // 2 byte response
     uint8_t rsp[2];
     ret = chanmux_nic_channel_ctrl_cmd(
-        channel_ctrl,
+        ctx,
         cmd, sizeof(cmd),
         rsp,
         sizeof(rsp));
     if (ret != OS_SUCCESS)
     {
         Debug_LOG_ERROR("Sending STOP_READ returned error %d", ret);
-        return OS_ERROR_GENERIC;
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
     }
     uint8_t rsp_result = rsp[0];
     if (rsp_result != CHANMUX_NIC_RSP_STOP_READ)
@@ -284,15 +895,15 @@ chanmux_nic_ctrl_stopData(
 //------------------------------------------------------------------------------
 OS_Error_t
 chanmux_nic_ctrl_startData(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data)
+    chanmux_nic_drv_t *ctx)
 {
     OS_Error_t ret;
+    unsigned int chan_id_data = get_chanmux_channel_data(ctx)->id;
     uint8_t cmd[2] = {CHANMUX_NIC_CMD_START_READ, chan_id_data};
     // 2 byte response
     uint8_t rsp[2];
     ret = chanmux_nic_channel_ctrl_cmd(
-        channel_ctrl,
+        ctx,
         cmd,
         sizeof(cmd),
         rsp,
@@ -300,7 +911,7 @@ chanmux_nic_ctrl_startData(
     if (ret != OS_SUCCESS)
     {
         Debug_LOG_ERROR("Sending START_READ returned error %d", ret);
-        return OS_ERROR_GENERIC;
+        return (OS_ERROR_TIMEOUT == ret) ? ret : OS_ERROR_GENERIC;
     }
     uint8_t rsp_result = rsp[0];
     if (rsp_result != CHANMUX_NIC_RSP_START_READ)
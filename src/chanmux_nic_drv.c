@@ -15,12 +15,454 @@
 #include "network/OS_NetworkStackTypes.h"
 #include "ChanMux/ChanMuxCommon.h"
 #include "chanmux_nic_drv.h"
-#include <sel4/sel4.h> // needed for seL4_yield()
+#include "chanmux_nic_drv_api.h"
+#include "chanmux_nic_rx_parser.h"
+#include "chanmux_nic_rx_steer.h"
+#include "chanmux_nic_rx_lro.h"
+#include "chanmux_nic_tx_tso.h"
+#include "chanmux_nic_crc32.h"
+#include "chanmux_nic_csum.h"
+#include <sel4/sel4.h> // needed for seL4_Yield()
 #include <string.h>
 
-// If we pass the define from a system configuration header. CAmkES generation
-// crashes when parsing this file. As a workaround we hardcode the value here
-#define NIC_DRIVER_RINGBUFFER_NUMBER_ELEMENTS 16
+//------------------------------------------------------------------------------
+// Latency tracing, the time stamps are 0 if tracing is disabled.
+//------------------------------------------------------------------------------
+static uint64_t
+latency_now(
+    const chanmux_nic_drv_t *ctx)
+{
+    uint64_t now_ns = 0;
+    if (ctx->latency.enabled)
+    {
+        (void)get_time_ns(ctx, &now_ns);
+    }
+    return now_ns;
+}
+
+//------------------------------------------------------------------------------
+// Record the time since start_ns for a stage, returns the current time so
+// consecutive stages can be chained.
+static uint64_t
+latency_record(
+    chanmux_nic_drv_t *ctx,
+    chanmux_nic_drv_latency_stage_t stage,
+    uint64_t start_ns)
+{
+    if (!ctx->latency.enabled)
+    {
+        return 0;
+    }
+
+    uint64_t now_ns = latency_now(ctx);
+    uint64_t delta_ns = now_ns - start_ns;
+
+    unsigned int idx = 0;
+    if (delta_ns >= 128)
+    {
+        // highest bit set, 128 (bit 7) goes into bucket 1
+        idx = (63 - __builtin_clzll(delta_ns)) - 6;
+        if (idx >= CHANMUX_NIC_DRV_LATENCY_BUCKETS)
+        {
+            idx = CHANMUX_NIC_DRV_LATENCY_BUCKETS - 1;
+        }
+    }
+
+    chanmux_nic_drv_latency_hist_t *hist = &ctx->stats->latency[stage];
+    hist->count++;
+    hist->sum_ns += delta_ns;
+    if (delta_ns > hist->max_ns)
+    {
+        hist->max_ns = delta_ns;
+    }
+    hist->bucket[idx]++;
+
+    return now_ns;
+}
+
+//------------------------------------------------------------------------------
+// Take back the slots of a chained frame that was not completed. The network
+// stack does not process a chain before its last slot is set, so it has not
+// touched them. A segment LRO appends to a held frame is taken back the same
+// way, the held frame ends in the slot it started in.
+static void
+rx_chain_discard(
+    chanmux_nic_drv_t *ctx)
+{
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[ctx->rx.cur];
+    const unsigned int ring_elements = get_rx_ring_elements(ctx, ctx->rx.cur);
+
+    while (ctx->rx.chain_slots > 0)
+    {
+        cl->pos = (cl->pos + ring_elements - 1) % ring_elements;
+        cl->ring[cl->pos].len = 0;
+        ctx->rx.chain_slots--;
+    }
+    ctx->rx.lro.append = false;
+}
+
+//------------------------------------------------------------------------------
+// Early RX filter, decides on the destination MAC if a frame is copied into
+// the ring at all.
+static bool
+rx_filter_accept(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *hdr,
+    size_t len)
+{
+    static const uint8_t broadcast[MAC_SIZE] =
+    {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+
+    const uint32_t flags = ctx->rx.filter.flags;
+    if (!is_rx_filter_enabled(ctx) || (len < MAC_SIZE) ||
+        (0 != (flags & CHANMUX_NIC_DRV_RX_FILTER_PROMISC)))
+    {
+        return true;
+    }
+
+    // the group bit is the lowest bit of the first byte
+    if (0 != (hdr[0] & 0x01))
+    {
+        return (0 == memcmp(hdr, broadcast, MAC_SIZE)) ||
+               (0 != (flags & CHANMUX_NIC_DRV_RX_FILTER_ALL_MULTI)) ||
+               (0 != (ctx->rx.filter.mcast_hash &
+                      chanmux_nic_driver_mcast_hash(hdr)));
+    }
+
+    const chanmux_nic_drv_caps_t *caps = get_caps(ctx);
+    return !caps->mac_valid || (0 == memcmp(hdr, caps->mac, MAC_SIZE));
+}
+
+//------------------------------------------------------------------------------
+// RX checksum offload, check the frame that ends in the current slot of the
+// current client. Its headers are in the first slot of the chain. Returns the
+// flags for the slot length.
+static size_t
+rx_csum_flags(
+    chanmux_nic_drv_t *ctx,
+    const chanmux_nic_rx_parser_t *parser)
+{
+    if (!is_rx_csum_offload_enabled(ctx))
+    {
+        return 0;
+    }
+
+    const chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[ctx->rx.cur];
+    const unsigned int first = (cl->pos + cl->ring_elements - ctx->rx.chain_slots) %
+                               cl->ring_elements;
+    const uint8_t *hdr = cl->ring[first].data;
+    size_t len = chanmux_nic_rx_parser_get_buffer_len(parser);
+    size_t hdr_len = (ctx->rx.chain_slots > 0) ? sizeof(cl->ring->data) : len;
+
+    if (!chanmux_nic_csum_verify(hdr, hdr_len,
+                                 chanmux_nic_rx_parser_get_frame_len(parser),
+                                 chanmux_nic_rx_parser_get_csum(parser),
+                                 &cl->ring[cl->pos].data[len], len))
+    {
+        return 0;
+    }
+
+    ctx->stats->rx_csum_ok++;
+    return CHANMUX_NIC_DRV_RX_LEN_CSUM_OK;
+}
+
+//------------------------------------------------------------------------------
+// Hand a frame that ends in the current slot of a client over to the network
+// stack. Notifications are batched, we send one when the batch is full or the
+// next slot is still in use. Any frames left in a batch are announced before
+// we block waiting for new ChanMUX data.
+static void
+rx_frame_done(
+    chanmux_nic_drv_t *ctx,
+    unsigned int client,
+    size_t slot_len,
+    size_t frame_len,
+    uint64_t trace_ns)
+{
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[client];
+
+    cl->ring[cl->pos].len = slot_len;
+    // the stack time is traced for client 0 only
+    if ((0 == client) && (cl->pos < CHANMUX_NIC_DRV_LATENCY_MAX_SLOTS))
+    {
+        ctx->latency.slot_ns[cl->pos] = trace_ns;
+    }
+    cl->pos = (cl->pos + 1) % cl->ring_elements;
+    cl->batch_frames++;
+    ctx->stats->rx_frames++;
+    ctx->stats->rx_bytes += frame_len;
+    ctx->stats->rx_client_frames[client]++;
+    if ((cl->batch_frames >= get_rx_batch_max_frames(ctx)) ||
+        (0 != cl->ring[cl->pos].len))
+    {
+        network_stack_notify(ctx, client);
+        ctx->stats->rx_notifications++;
+        cl->batch_frames = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Large receive offload. A TCP segment that can be merged is held in the ring,
+// its last slot gets no length yet. The payload of the next segments of the
+// flow is parsed directly behind it, their headers are dropped. A segment
+// with a bad checksum is taken back and dropped, as its data has overwritten
+// the space behind the held frame.
+//------------------------------------------------------------------------------
+static void
+rx_lro_flush(
+    chanmux_nic_drv_t *ctx)
+{
+    // a segment that is appended right now completes the frame first
+    chanmux_nic_drv_rx_lro_t *lro = &ctx->rx.lro;
+    if (!lro->held || lro->append)
+    {
+        return;
+    }
+    lro->held = false;
+
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[lro->client];
+    if (lro->segs > 1)
+    {
+        chanmux_nic_rx_lro_finish(cl->ring[lro->first].data, lro->ip,
+                                  lro->hdr_len, lro->len, lro->payload_sum,
+                                  lro->push);
+    }
+
+    // all segments were verified, the new checksums are correct
+    size_t flags = 0;
+    if (is_rx_csum_offload_enabled(ctx))
+    {
+        ctx->stats->rx_csum_ok++;
+        flags = CHANMUX_NIC_DRV_RX_LEN_CSUM_OK;
+    }
+    rx_frame_done(ctx, lro->client, lro->tail_len | flags, lro->len,
+                  latency_now(ctx));
+}
+
+//------------------------------------------------------------------------------
+static bool
+rx_lro_is_expired(
+    const chanmux_nic_drv_t *ctx)
+{
+    const uint64_t timeout_ns = get_rx_lro_timeout_ns(ctx);
+    uint64_t now_ns;
+
+    return ctx->rx.lro.held && (0 != timeout_ns) && get_time_ns(ctx, &now_ns) &&
+           (now_ns - ctx->rx.lro.start_ns >= timeout_ns);
+}
+
+//------------------------------------------------------------------------------
+// Check if the held frame has room for a segment, in bytes and in ring slots.
+// The slots are counted for the worst case, so the held frame never wraps
+// around the ring.
+static bool
+rx_lro_has_room(
+    const chanmux_nic_drv_t *ctx,
+    const chanmux_nic_drv_rx_lro_seg_t *seg)
+{
+    const chanmux_nic_drv_rx_lro_t *lro = &ctx->rx.lro;
+    const chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[lro->client];
+    const size_t len = lro->len + seg->payload_len;
+
+    return (len <= lro->max_len) && (len - lro->ip <= 0xFFFF) &&
+           (lro->slots + (seg->payload_len / sizeof(cl->ring->data)) + 2 <=
+            cl->ring_elements);
+}
+
+//------------------------------------------------------------------------------
+// A new frame of the current client starts, decide if it is appended to the
+// held frame. Anything else hands the held frame over first.
+static void
+rx_lro_frame_start(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len)
+{
+    chanmux_nic_drv_rx_lro_t *lro = &ctx->rx.lro;
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[ctx->rx.cur];
+
+    lro->append = false;
+    lro->candidate = chanmux_nic_rx_lro_get_seg(hdr, hdr_len, frame_len,
+                                                &lro->seg);
+    if (!lro->held)
+    {
+        return;
+    }
+
+    if (!lro->candidate || (ctx->rx.cur != lro->client) ||
+        (lro->seg.seq != lro->next_seq) || !rx_lro_has_room(ctx, &lro->seg) ||
+        rx_lro_is_expired(ctx) ||
+        !chanmux_nic_rx_lro_is_same_flow(cl->ring[lro->first].data,
+                                         lro->hdr_len, hdr, &lro->seg))
+    {
+        rx_lro_flush(ctx);
+        return;
+    }
+
+    // The payload bytes collected with the headers must fit into the last
+    // slot, otherwise it is closed as it is and the data starts in the next.
+    // A chain may have slots that are not full.
+    lro->append = true;
+    lro->buf_used = lro->tail_len;
+    if (hdr_len - lro->seg.hdr_len > sizeof(cl->ring->data) - lro->tail_len)
+    {
+        cl->ring[cl->pos].len = lro->tail_len | CHANMUX_NIC_DRV_RX_LEN_CHAINED;
+        cl->pos = (cl->pos + 1) % cl->ring_elements;
+        ctx->rx.chain_slots++;
+        lro->buf_used = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// The frame in progress is complete. Returns true if it was held or appended
+// to the held frame, false if it goes to the network stack as usual.
+static bool
+rx_lro_frame_done(
+    chanmux_nic_drv_t *ctx,
+    const chanmux_nic_rx_parser_t *parser)
+{
+    chanmux_nic_drv_rx_lro_t *lro = &ctx->rx.lro;
+    const chanmux_nic_drv_rx_lro_seg_t *seg = &lro->seg;
+    const chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[ctx->rx.cur];
+    uint64_t payload_sum;
+
+    if (lro->append)
+    {
+        if (!chanmux_nic_rx_lro_check_seg(seg,
+                                          chanmux_nic_rx_parser_get_csum(parser),
+                                          &payload_sum))
+        {
+            Debug_LOG_WARNING("dropped TCP segment of %zu bytes, checksum error",
+                              chanmux_nic_rx_parser_get_frame_len(parser));
+            rx_chain_discard(ctx);
+            ctx->stats->rx_lro_dropped++;
+            return true;
+        }
+        lro->append = false;
+
+        // the headers have an even length, so the payload of a segment starts
+        // at an odd offset of the merged payload if the one before is odd
+        lro->payload_sum = chanmux_nic_csum_add(lro->payload_sum, payload_sum,
+                                                (lro->len - lro->hdr_len) & 1);
+        lro->len += seg->payload_len;
+        lro->tail_len = chanmux_nic_rx_parser_get_buffer_len(parser);
+        lro->slots += ctx->rx.chain_slots;
+        lro->next_seq += seg->payload_len;
+        lro->segs++;
+        ctx->rx.chain_slots = 0;
+        ctx->stats->rx_lro_merged++;
+        if (0 != (seg->flags & TCP_FLAG_PSH))
+        {
+            lro->push = true;
+            rx_lro_flush(ctx);
+        }
+        return true;
+    }
+
+    // a segment with PSH is not held, nothing is merged into it
+    if (!lro->candidate || (0 != (seg->flags & TCP_FLAG_PSH)) ||
+        !chanmux_nic_rx_lro_check_seg(seg, chanmux_nic_rx_parser_get_csum(parser),
+                                      &payload_sum))
+    {
+        return false;
+    }
+
+    lro->held = true;
+    lro->client = ctx->rx.cur;
+    lro->first = (cl->pos + cl->ring_elements - ctx->rx.chain_slots) %
+                 cl->ring_elements;
+    lro->slots = ctx->rx.chain_slots + 1;
+    lro->tail_len = chanmux_nic_rx_parser_get_buffer_len(parser);
+    lro->len = chanmux_nic_rx_parser_get_frame_len(parser);
+    lro->hdr_len = seg->hdr_len;
+    lro->ip = seg->ip;
+    lro->segs = 1;
+    lro->next_seq = seg->seq + seg->payload_len;
+    lro->payload_sum = payload_sum;
+    lro->push = false;
+    (void)get_time_ns(ctx, &lro->start_ns);
+    ctx->rx.chain_slots = 0;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Notify all network stack clients that have frames in their ring they don't
+// know about yet.
+static void
+rx_notify_pending(
+    chanmux_nic_drv_t *ctx)
+{
+    for (unsigned int i = 0; i < get_rx_clients(ctx); i++)
+    {
+        chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[i];
+        if (cl->batch_frames > 0)
+        {
+            network_stack_notify(ctx, i);
+            ctx->stats->rx_notifications++;
+            cl->batch_frames = 0;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Adaptive polling. An event starts a poll run, where the FIFO is read without
+// waiting until a read returns nothing or the budget is used up. A budget that
+// is used up means high load, so it grows for the next run. A FIFO that runs
+// empty means the budget was more than the load needs, so it shrinks. It never
+// gets smaller than one full read.
+static void
+rx_poll_update(
+    chanmux_nic_drv_t *ctx,
+    bool polled,
+    size_t len_read,
+    size_t read_size)
+{
+    const size_t budget_max = get_rx_poll_budget(ctx);
+    if (0 == budget_max)
+    {
+        return;
+    }
+    const size_t budget_min = (read_size < budget_max) ? read_size : budget_max;
+
+    if (0 == len_read)
+    {
+        if (polled)
+        {
+            ctx->rx.poll_budget /= 2;
+            ctx->stats->rx_poll_empty++;
+        }
+        ctx->rx.poll_left = 0;
+    }
+    else
+    {
+        if (!polled)
+        {
+            ctx->rx.poll_left = ctx->rx.poll_budget;
+        }
+
+        if (len_read < ctx->rx.poll_left)
+        {
+            ctx->rx.poll_left -= len_read;
+            return;
+        }
+
+        // go through the event again, it is pending if more data has arrived
+        ctx->rx.poll_left = 0;
+        ctx->rx.poll_budget *= 2;
+    }
+
+    if (ctx->rx.poll_budget < budget_min)
+    {
+        ctx->rx.poll_budget = budget_min;
+    }
+    if (ctx->rx.poll_budget > budget_max)
+    {
+        ctx->rx.poll_budget = budget_max;
+    }
+}
 
 //------------------------------------------------------------------------------
 // Receive loop, waits for an interrupt signal from ChanMUX, reads data and
@@ -30,46 +472,101 @@
 // Therefore we suppress the cyclomatic complexity analysis for this function.
 // metrix++: suppress std.code.complexity:cyclomatic
 OS_Error_t
-chanmux_nic_driver_loop(void)
+chanmux_nic_driver_loop(
+    chanmux_nic_drv_t *ctx)
 {
-    const ChanMux_ChannelOpsCtx_t *ctrl = get_chanmux_channel_ctrl();
-    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data();
-
-    const OS_SharedBuffer_t *nw_input = get_network_stack_port_to();
-    OS_NetworkStack_RxBuffer_t *nw_rx = (OS_NetworkStack_RxBuffer_t *)
-                                            nw_input->buffer;
-
-    static unsigned int pos = 0;
-    size_t rx_slot_buffer_len = sizeof(nw_rx->data);
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+
+    // the ring of the client that gets the current frame
+    const unsigned int clients = get_rx_clients(ctx);
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[ctx->rx.cur];
+
+    const size_t rx_slot_buffer_len = sizeof(cl->ring->data);
+    // frames can span the whole ring if slots are chained. Larger frames
+    // could never be completed, because the stack releases slots per frame.
+    // Any client may get a frame, so the smallest ring counts.
+    size_t rx_max_frame_len = rx_slot_buffer_len;
+    if (is_rx_chain_slots_enabled(ctx))
+    {
+        unsigned int ring_elements = get_rx_ring_elements(ctx, 0);
+        for (unsigned int i = 1; i < clients; i++)
+        {
+            if (get_rx_ring_elements(ctx, i) < ring_elements)
+            {
+                ring_elements = get_rx_ring_elements(ctx, i);
+            }
+        }
+        rx_max_frame_len = rx_slot_buffer_len * ring_elements;
+    }
+    if (rx_max_frame_len > get_caps(ctx)->max_frame_len)
+    {
+        // the peer does not send bigger frames
+        rx_max_frame_len = get_caps(ctx)->max_frame_len;
+    }
 
-    // since the ChanMUX channel data port is used by send and receive, we
-    // have to copy the data into an intermediate buffer, otherwise it will
-    // be overwritten. Define the buffer as static will not create it on the
-    // stack
-    static uint8_t buffer[ETHERNET_FRAME_MAX_SIZE];
+    // if the ChanMUX channel data port is used by send and receive, we have
+    // to copy the data into an intermediate buffer, otherwise it will be
+    // overwritten. The buffer is part of the context, so it is not created on
+    // the stack. In zero-copy mode the frames are parsed directly in the read
+    // dataport, which nobody else touches until we call read() again. Then a
+    // frame that straddles two reads needs no special care, because its
+    // payload goes straight into the ring slot and only the length prefix
+    // state is kept across reads.
+    uint8_t *staging_buffer = ctx->rx.staging_buffer;
+    const bool zero_copy = is_rx_zero_copy_enabled(ctx);
+    const uint8_t *buffer = zero_copy
+                            ? OS_Dataport_getBuf(data->port.read)
+                            : staging_buffer;
+    const size_t buffer_size = zero_copy
+                               ? OS_Dataport_getSize(data->port.read)
+                               : sizeof(ctx->rx.staging_buffer);
     size_t buffer_offset = 0;
     size_t buffer_len = 0;
 
-    // Data format is:  2 byte frame length | frame data | .....
+    // the parser takes care of the data format, we just feed it with the
+    // data we read and hand over the frames to the network stack. With framing
+    // v2 it can find the next frame in-band after an error, so there is no
+    // need to stop and drain the channel.
+    const bool framing_v2 = is_rx_framing_v2_enabled(ctx);
+    const bool read_blocking = has_chanmux_channel_data_read_blocking(ctx);
+    chanmux_nic_rx_parser_t parser;
+    chanmux_nic_rx_parser_init(&parser, rx_max_frame_len,
+                               framing_v2 ? CHANMUX_NIC_RX_PARSER_FRAMING_V2
+                               : CHANMUX_NIC_RX_PARSER_FRAMING_V1);
+    chanmux_nic_rx_parser_set_buffer_size(&parser, rx_slot_buffer_len);
+    // with several clients, the headers decide which ring a frame goes to.
+    // The filter just needs the destination MAC. LRO looks at the most, the
+    // whole TCP header.
+    const bool lro = (0 != get_rx_lro_max_len(ctx));
+    if (lro)
+    {
+        chanmux_nic_rx_parser_set_peek_len(&parser, CHANMUX_NIC_RX_LRO_HDR_LEN);
+    }
+    else if (clients > 1)
+    {
+        chanmux_nic_rx_parser_set_peek_len(&parser, CHANMUX_NIC_RX_STEER_HDR_LEN);
+    }
+    else if (is_rx_filter_enabled(ctx))
+    {
+        chanmux_nic_rx_parser_set_peek_len(&parser, MAC_SIZE);
+    }
+    chanmux_nic_rx_parser_set_csum(&parser,
+                                   is_rx_csum_offload_enabled(ctx) || lro);
+
     enum state_e
     {
         RECEIVE_ERROR = 0,
-        RECEIVE_FRAME_START,
-        RECEIVE_FRAME_LEN,
-        RECEIVE_FRAME_DATA,
+        RECEIVE_FRAME,
         RECEIVE_PROCESSING
-    } state = RECEIVE_FRAME_START;
+    } state = RECEIVE_FRAME;
 
-    size_t size_len = 0;
-    size_t frame_len = 0;
-    size_t frame_offset = 0;
     size_t yield_counter = 0;
+    uint64_t slot_wait_start_ns = 0;
     int doRead = true;
-    int doDropFrame = false;
 
     // The Proxy needs to get a START command in order to
     // forward frames from the TAP interface
-    OS_Error_t err = chanmux_nic_ctrl_startData(ctrl, data->id);
+    OS_Error_t err = chanmux_nic_ctrl_startData(ctx);
     if (err != OS_SUCCESS)
     {
         Debug_LOG_ERROR("chanmux_nic_ctrl_startData() failed, code %d", err);
@@ -88,6 +585,22 @@ chanmux_nic_driver_loop(void)
         //       a reset of the NIC driver.
         while (doRead || (RECEIVE_ERROR == state))
         {
+            // while polling, the FIFO is read without waiting for the event
+            const bool poll = (ctx->rx.poll_left > 0) && (RECEIVE_ERROR != state);
+
+            // never block with frames in the ring the network stack does not
+            // know about yet, this bounds the latency a batch can add. A held
+            // LRO frame goes also, there is nothing to merge it with now.
+            if (!poll)
+            {
+                rx_lro_flush(ctx);
+                rx_notify_pending(ctx);
+            }
+            else if (rx_lro_is_expired(ctx))
+            {
+                rx_lro_flush(ctx);
+            }
+
             // in error state we simply drop all remaining data
             if (RECEIVE_ERROR == state)
             {
@@ -96,7 +609,7 @@ chanmux_nic_driver_loop(void)
                 /// server that should provide us the getTime() facility cannot
                 /// handle more than one client
                 Debug_LOG_WARNING("Chanmux receive error, resetting FIFO");
-                OS_Error_t err = chanmux_nic_ctrl_stopData(ctrl, data->id);
+                OS_Error_t err = chanmux_nic_ctrl_stopData(ctx);
                 if (err != OS_SUCCESS)
                 {
                     Debug_LOG_ERROR("chanmux_nic_ctrl_stopData() failed, code %d", err);
@@ -111,16 +624,19 @@ chanmux_nic_driver_loop(void)
                 // drain the channel FIFO
                 do
                 {
-                    err = data->func.read(data->id, sizeof(buffer), &buffer_len);
+                    err = data->func.read(data->id, buffer_size, &buffer_len);
                     if (err == OS_ERROR_OVERFLOW_DETECTED)
                     {
                         continue;
                     }
                 } while (buffer_len > 0);
 
-                state = RECEIVE_FRAME_START;
+                chanmux_nic_rx_parser_reset(&parser);
+                rx_chain_discard(ctx);
+                state = RECEIVE_FRAME;
+                ctx->stats->rx_resets++;
 
-                err = chanmux_nic_ctrl_startData(ctrl, data->id);
+                err = chanmux_nic_ctrl_startData(ctx);
                 if (err != OS_SUCCESS)
                 {
                     Debug_LOG_ERROR("chanmux_nic_ctrl_startData() failed, code %d", err);
@@ -133,23 +649,69 @@ chanmux_nic_driver_loop(void)
                 Debug_ASSERT(0 == buffer_len);
             }
 
-            // ToDo: actually, we want a single atomic blocking read RPC call
-            //       here and not the two calls of wait() and read().
-            chanmux_channel_data_wait();
-
             // read as much data as possible from the ChanMUX channel FIFO into
             // the shared memory data port. We do this even in the state
-            // RECEIVE_ERROR, because we have to drain the FIFOs.
-            OS_Error_t err = data->func.read(
-                data->id,
-                sizeof(buffer),
-                &buffer_len);
+            // RECEIVE_ERROR, because we have to drain the FIFOs. If ChanMUX
+            // offers a blocking read, waiting and reading is a single call.
+            // Polling needs the non-blocking read.
+            OS_Error_t err;
+            uint64_t trace_ns = latency_now(ctx);
+            if (poll)
+            {
+                ctx->stats->rx_polled_reads++;
+                err = data->func.read(data->id, buffer_size, &buffer_len);
+            }
+            else if (read_blocking)
+            {
+                err = chanmux_channel_data_read_blocking(ctx, buffer_size,
+                                                         &buffer_len);
+            }
+            else
+            {
+                chanmux_channel_data_wait(ctx);
+                trace_ns = latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_RX_DATA_WAIT,
+                                          trace_ns);
+                err = data->func.read(data->id, buffer_size, &buffer_len);
+            }
+            (void)latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_RX_READ, trace_ns);
             if (err != OS_SUCCESS)
             {
                 Debug_LOG_ERROR("ChanMuxRpc_read() %s, error %d, state=%d",
                                 (OS_ERROR_OVERFLOW_DETECTED == err) ? "reported OVERFLOW" : "failed",
                                 err, state);
-                state = RECEIVE_ERROR;
+                if (OS_ERROR_OVERFLOW_DETECTED == err)
+                {
+                    ctx->stats->rx_overflows++;
+                }
+                else
+                {
+                    ctx->stats->rx_read_errors++;
+                }
+                ctx->rx.poll_left = 0;
+
+                if (framing_v2)
+                {
+                    // data is lost, so any partial frame is useless. The
+                    // parser finds the start of the next frame in the data
+                    // that follows. A frame waiting for a slot is gone also.
+                    buffer_len = 0;
+                    chanmux_nic_rx_parser_reset(&parser);
+                    rx_chain_discard(ctx);
+                    ctx->stats->rx_resyncs++;
+                    state = RECEIVE_FRAME;
+                }
+                else
+                {
+                    state = RECEIVE_ERROR;
+                }
+            }
+            else
+            {
+                if ((0 == buffer_len) && !poll)
+                {
+                    ctx->stats->rx_empty_reads++;
+                }
+                rx_poll_update(ctx, poll, buffer_len, buffer_size);
             }
 
             // it can happen that we wanted to read new data, blocked on the
@@ -161,7 +723,11 @@ chanmux_nic_driver_loop(void)
             // here exactly because the state machine has run out of data.
             if ((RECEIVE_ERROR != state) && (0 != buffer_len))
             {
-                memcpy(buffer, OS_Dataport_getBuf(data->port.read), buffer_len);
+                if (!zero_copy)
+                {
+                    memcpy(staging_buffer, OS_Dataport_getBuf(data->port.read),
+                           buffer_len);
+                }
                 buffer_offset = 0;
                 doRead = false; // ensure we leave the loop
             }
@@ -176,140 +742,140 @@ chanmux_nic_driver_loop(void)
         switch (state)
         {
         //----------------------------------------------------------------------
-        case RECEIVE_FRAME_START:
-            size_len = 2;
-            frame_len = 0;
-            frame_offset = 0;
-            doDropFrame = false;
-            Debug_ASSERT(!doRead);
-            state = RECEIVE_FRAME_LEN;
-            break; // could also fall through
-
-        //----------------------------------------------------------------------
-        case RECEIVE_FRAME_LEN:
-
-            Debug_ASSERT(0 != size_len);
-            if (0 == buffer_len)
+        case RECEIVE_FRAME:
+            if ((0 == buffer_len) &&
+                !chanmux_nic_rx_parser_has_pending_frame(&parser))
             {
                 doRead = true;
                 break;
             }
 
-            do
             {
-                Debug_ASSERT(buffer_offset + buffer_len <= sizeof(buffer));
-
-                uint8_t len_byte = buffer[buffer_offset++];
-                buffer_len--;
-                size_len--;
+                size_t consumed = 0;
+                uint64_t trace_ns = latency_now(ctx);
+                chanmux_nic_rx_parser_event_t event = chanmux_nic_rx_parser_feed(
+                                                          &parser,
+                                                          &buffer[buffer_offset],
+                                                          buffer_len,
+                                                          &consumed);
+                trace_ns = latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_RX_PARSE,
+                                          trace_ns);
+                Debug_ASSERT(buffer_len >= consumed);
+                buffer_len -= consumed;
+                buffer_offset += consumed;
+                if (framing_v2)
+                {
+                    ctx->stats->rx_lost_frames +=
+                        chanmux_nic_rx_parser_take_lost_frames(&parser);
+                }
 
-                // frame length is send in network byte order (big endian), so we
-                // build the value as: 0x0000 -> 0x00AA -> 0xAABB
-                frame_len <<= 8;
-                frame_len |= len_byte;
+                size_t frame_len = chanmux_nic_rx_parser_get_frame_len(&parser);
+                switch (event)
+                {
+                case CHANMUX_NIC_RX_PARSER_NEED_DATA:
+                    // wait for more data to complete the frame
+                    Debug_ASSERT(0 == buffer_len);
+                    doRead = true;
+                    break;
 
-            } while ((buffer_len > 0) && (size_len > 0));
+                case CHANMUX_NIC_RX_PARSER_NEED_BUFFER:
+                    // the frame goes into the next ring slot, which may still
+                    // be in use by the network stack
+                    if (chanmux_nic_rx_parser_get_buffer_len(&parser) > 0)
+                    {
+                        // the slot is full, the frame continues in the next
+                        // one. The stack must know all complete frames before
+                        // we wait for that slot.
+                        cl->ring[cl->pos].len = rx_slot_buffer_len |
+                                                CHANMUX_NIC_DRV_RX_LEN_CHAINED;
+                        cl->pos = (cl->pos + 1) % cl->ring_elements;
+                        ctx->rx.chain_slots++;
+                    }
+                    else
+                    {
+                        Debug_LOG_TRACE("expecting ethernet frame of %zu bytes",
+                                        frame_len);
+                        size_t hdr_len;
+                        const uint8_t *hdr = chanmux_nic_rx_parser_get_peek(
+                                                 &parser, &hdr_len);
+                        if (!rx_filter_accept(ctx, hdr, hdr_len))
+                        {
+                            // the rest of the frame is consumed without a copy
+                            chanmux_nic_rx_parser_skip_frame(&parser);
+                            break;
+                        }
+                        if (clients > 1)
+                        {
+                            ctx->rx.cur = chanmux_nic_rx_steer(ctx, hdr, hdr_len);
+                            cl = &ctx->rx.client[ctx->rx.cur];
+                        }
+                        if (lro)
+                        {
+                            rx_lro_frame_start(ctx, hdr, hdr_len, frame_len);
+                        }
+                    }
+                    yield_counter = 0;
+                    slot_wait_start_ns = trace_ns;
+                    if (0 != cl->ring[cl->pos].len)
+                    {
+                        ctx->stats->rx_ring_full++;
+                        rx_notify_pending(ctx);
+                    }
+                    state = RECEIVE_PROCESSING;
+                    break;
 
-            if (size_len > 0)
-            {
-                Debug_ASSERT(0 == buffer_len);
-                doRead = true;
-                break;
-            }
+                case CHANMUX_NIC_RX_PARSER_FRAME_DROPPED:
+                    Debug_LOG_WARNING(
+                        "dropped frame of %zu bytes, max frame size is %zu",
+                        frame_len,
+                        rx_max_frame_len);
+                    ctx->stats->rx_dropped++;
+                    break;
 
-            // we have read the length, make some sanity check and then
-            // change state to read the frame data
-            Debug_LOG_TRACE("expecting ethernet frame of %zu bytes", frame_len);
-            Debug_ASSERT(0 == frame_offset);
-            Debug_ASSERT(frame_len <= ETHERNET_FRAME_MAX_SIZE);
-            // if the frame is too big for our buffer, then the only option is
-            // dropping it
-            doDropFrame = (frame_len > rx_slot_buffer_len);
-            if (doDropFrame)
-            {
-                Debug_LOG_WARNING(
-                    "frame length %zu exceeds frame buffer size %zu, drop it",
-                    frame_len,
-                    rx_slot_buffer_len);
-            }
+                case CHANMUX_NIC_RX_PARSER_FRAME_SKIPPED:
+                    ctx->stats->rx_filtered++;
+                    break;
 
-            // read the frame data
-            Debug_ASSERT(!doRead);
-            state = RECEIVE_FRAME_DATA;
-            break; // could also fall through
+                case CHANMUX_NIC_RX_PARSER_FRAME_CORRUPT:
+                    // the slot has the corrupted data, but we don't hand it
+                    // over. The next frame will overwrite it.
+                    Debug_LOG_WARNING("dropped frame of %zu bytes, CRC error",
+                                      frame_len);
+                    rx_chain_discard(ctx);
+                    ctx->stats->rx_crc_errors++;
+                    break;
 
-        //----------------------------------------------------------------------
-        case RECEIVE_FRAME_DATA:
-            if (0 == buffer_len)
-            {
-                doRead = true;
-                break;
-            }
+                case CHANMUX_NIC_RX_PARSER_SYNC_LOST:
+                    Debug_LOG_WARNING("invalid frame header, searching next frame");
+                    ctx->stats->rx_resyncs++;
+                    break;
 
-            {
-                size_t chunk_len = frame_len - frame_offset;
-                if (chunk_len > buffer_len)
-                {
-                    chunk_len = buffer_len;
-                }
+                case CHANMUX_NIC_RX_PARSER_FRAME:
+                    // hand the frame over to the network stack, unless LRO
+                    // holds it back to merge more segments into it
+                    // Debug_LOG_DEBUG("got ethernet frame of %zu bytes", frame_len);
+                    if (lro && rx_lro_frame_done(ctx, &parser))
+                    {
+                        break;
+                    }
+                    rx_frame_done(ctx, ctx->rx.cur,
+                                  chanmux_nic_rx_parser_get_buffer_len(&parser) |
+                                  rx_csum_flags(ctx, &parser),
+                                  frame_len, trace_ns);
+                    ctx->rx.chain_slots = 0;
+                    break;
 
-                if (!doDropFrame)
-                {
-                    // we can't handle frame bigger than our buffer and the only
-                    // option in this case is dropping the frame
-                    Debug_ASSERT(chunk_len < rx_slot_buffer_len);
-                    Debug_ASSERT(frame_offset + chunk_len < rx_slot_buffer_len);
-
-                    // ToDo: we could try to avoid this copy operation and just
-                    //       have one shared memory for the ChanMUX channel and the
-                    //       network stack input. But that requires more
-                    //       synchronization then and we have to deal with cases
-                    //       where a frame wraps around in the buffer.
-                    uint8_t *nw_in_buf = (uint8_t *)nw_rx[pos].data;
-                    memcpy(&nw_in_buf[frame_offset],
-                           &buffer[buffer_offset],
-                           chunk_len);
+                default:
+                    Debug_LOG_ERROR("invalid parser event %d", event);
+                    break;
                 }
-
-                Debug_ASSERT(buffer_len >= chunk_len);
-                buffer_len -= chunk_len;
-                buffer_offset += chunk_len;
-                frame_offset += chunk_len;
-            }
-
-            // check if we have received the full frame. If not then wait for
-            // more data
-            if (frame_offset < frame_len)
-            {
-                Debug_ASSERT(0 == buffer_len);
-                doRead = true;
-                break;
-            }
-
-            // we have a full frame. If we skip the frame then we are done and
-            // try to read the next frame
-            if (doDropFrame)
-            {
-                Debug_ASSERT(!doRead);
-                state = RECEIVE_FRAME_START;
-                break;
             }
-
-            // notify network stack that it can process an new frame
-            // Debug_LOG_DEBUG("got ethernet frame of %zu bytes", frame_len);
-            nw_rx[pos].len = frame_len;
-            pos = (pos + 1) % NIC_DRIVER_RINGBUFFER_NUMBER_ELEMENTS;
-            network_stack_notify();
-
-            yield_counter = 0;
-            Debug_ASSERT(!doRead);
-            state = RECEIVE_PROCESSING;
-            break; // could also fall through
+            break;
 
         //----------------------------------------------------------------------
         case RECEIVE_PROCESSING:
             // check if the network stack has processed the frame.
-            if (0 != nw_rx[pos].len)
+            if (0 != cl->ring[cl->pos].len)
             {
                 // frame processing is still ongoing. Instead of going straight
                 // into blocking here, we can do an optimization here in case
@@ -329,19 +895,24 @@ chanmux_nic_driver_loop(void)
                     break;
                 }
 
-                // ToDo: here we should block on a signal that the network
-                //       stack sets when it has processed the frame. Until we
-                //       have this, yielding is the best thing we can do.
+                // Block on the signal that the network stack sets when it has
+                // released a slot. If the stack does not provide this signal,
+                // yielding is the best thing we can do. There is no point in
+                // waiting for ChanMUX data at the same time here, because the
+                // buffer still holds data and we can't read more before this
+                // has been consumed.
                 yield_counter++;
-                seL4_Yield();
-
-                // As long as we yield, there is not too much gain in checking
-                // nw_rx->len here again, as we basically run a big loop. But
-                // once we block waiting on a signal, checking here makes much
-                // sense, because we expect to find the length cleared. Note
-                // that we can't blindly assume this, because there might be
-                // corner cases where we could see spurious signals.
-                if (0 != nw_rx[pos].len)
+                ctx->stats->rx_slot_waits++;
+                if (!network_stack_rx_slot_wait(ctx, ctx->rx.cur))
+                {
+                    seL4_Yield();
+                }
+
+                // Check the slot again, as we expect to find the length
+                // cleared now. Note that we can't blindly assume this, because
+                // there might be corner cases where we could see spurious
+                // signals or the stack released a different slot.
+                if (0 != cl->ring[cl->pos].len)
                 {
                     break;
                 }
@@ -350,16 +921,18 @@ chanmux_nic_driver_loop(void)
             // if we arrive here, the network stack has processed the frame, so
             // we can give it the next frame.
 
-            // As long as we use yield instad of blocking on a singal, let's
+            // If we have to use yield instead of blocking on a signal, let's
             // have some statistics about how bad the yielding really is.
             // Ideally, we see no yields at all. But that happens very rarely
             // (especially in debug builds). One yield seem the standard case,
             // so we don't report this unless we are loggin at trace level.
             // The more yields we see happening, the higher the priority gets
-            // that we more to signals and stop wasint CPU time.
+            // that the network stack provides the slot release signal. Blocking
+            // on the signal does not waste CPU time, so it's always just trace.
             if (yield_counter > 0)
             {
-                if (1 == yield_counter)
+                if ((1 == yield_counter) ||
+                    has_network_stack_rx_slot_wait(ctx, ctx->rx.cur))
                 {
                     Debug_LOG_TRACE("yield_counter is %zu", yield_counter);
                 }
@@ -369,11 +942,37 @@ chanmux_nic_driver_loop(void)
                 }
             }
 
-            Debug_ASSERT(!doRead);
-            state = RECEIVE_FRAME_START;
-            break;
-
-        //----------------------------------------------------------------------
+            if (yield_counter > 0)
+            {
+                if ((0 == ctx->rx.cur) &&
+                    (cl->pos < CHANMUX_NIC_DRV_LATENCY_MAX_SLOTS))
+                {
+                    (void)latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_RX_STACK,
+                                         ctx->latency.slot_ns[cl->pos]);
+                }
+            }
+            (void)latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_RX_SLOT_WAIT,
+                                 slot_wait_start_ns);
+
+            // the frame data goes directly into the slot, an LRO segment
+            // without its headers behind the data of the held frame
+            if (ctx->rx.lro.append &&
+                (0 == chanmux_nic_rx_parser_get_buffer_len(&parser)))
+            {
+                chanmux_nic_rx_parser_append_buffer(&parser,
+                                                    cl->ring[cl->pos].data,
+                                                    ctx->rx.lro.buf_used,
+                                                    ctx->rx.lro.seg.hdr_len);
+            }
+            else
+            {
+                chanmux_nic_rx_parser_set_buffer(&parser, cl->ring[cl->pos].data);
+            }
+            Debug_ASSERT(!doRead);
+            state = RECEIVE_FRAME;
+            break;
+
+        //----------------------------------------------------------------------
         // case RECEIVE_ERROR
         default:
             // This is basically a safe-guard. Practically, we should never
@@ -389,130 +988,1492 @@ chanmux_nic_driver_loop(void)
 }
 
 //------------------------------------------------------------------------------
-// called by network stack to send an ethernet frame
-OS_Error_t
-chanmux_nic_driver_rpc_tx_data(
-    size_t *pLen)
+// TX checksum offload. A frame that is copied into the ChanMUX write port gets
+// its sum in the same pass, frames sent from elsewhere need a pass of their
+// own.
+//------------------------------------------------------------------------------
+static void
+tx_csum_copy(
+    chanmux_nic_drv_t *ctx,
+    uint8_t *dst,
+    const uint8_t *frame,
+    size_t len)
 {
-    size_t len = *pLen;
-    *pLen = 0;
+    if (!is_tx_csum_offload_enabled(ctx))
+    {
+        memcpy(dst, frame, len);
+        return;
+    }
 
-    Debug_LOG_TRACE("sending frame of %zu bytes ", len);
+    uint64_t sum = chanmux_nic_csum_copy(dst, frame, len, 0);
+    if (chanmux_nic_csum_fill(dst, len, sum))
+    {
+        ctx->stats->tx_csum_filled++;
+    }
+}
 
-    // Ethernet frames used to be max 1518 bytes. Then 802.1Q added a 4 byte
-    // Q-tag, so they can be 1522 bytes, which is a common default. However,
-    // there is also 802.1ad "Q-in-Q", where multiple Q-tags can be present.
-    // Thus we do not make any assumption here about the max size here and send
-    // whatever the network stack give us. With our 2-byte length prefix, the
-    // length can be up to 0xFFFF, so even jumbo frame with an MTU of 9000 byte
-    // would work.
-    if (len > 0xFFFF)
+//------------------------------------------------------------------------------
+static void
+tx_csum_fill(
+    chanmux_nic_drv_t *ctx,
+    uint8_t *frame,
+    size_t len)
+{
+    if (is_tx_csum_offload_enabled(ctx) &&
+        chanmux_nic_csum_fill(frame, len, chanmux_nic_csum_partial(frame, len, 0)))
+    {
+        ctx->stats->tx_csum_filled++;
+    }
+}
+
+//------------------------------------------------------------------------------
+// TX aggregation, frames are packed back to back into the ChanMUX write port
+// and sent with a single write() call. Whatever ChanMUX does not take stays in
+// the port and goes first with the next write.
+//------------------------------------------------------------------------------
+static OS_Error_t
+tx_aggr_flush(
+    chanmux_nic_drv_t *ctx)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
+
+    if (0 == ctx->tx.aggr.port_offset)
+    {
+        return OS_SUCCESS;
+    }
+
+    size_t len_to_write = ctx->tx.aggr.port_offset;
+    size_t len_written = 0;
+    ctx->stats->tx_writes++;
+    OS_Error_t err = data->func.write(
+        data->id,
+        len_to_write,
+        &len_written);
+    if (err != OS_SUCCESS)
     {
-        Debug_LOG_WARNING("can't send frame, len %zu exceeds max supported length %d",
-                          len, 0xFFFF);
+        // the pending frames are lost, the caller gets the error even if it
+        // has not added them itself
+        Debug_LOG_ERROR("ChanMuxRpc_write() failed, error %d, drop %u frames",
+                        err, ctx->tx.aggr.frames);
+        ctx->stats->tx_dropped += ctx->tx.aggr.frames;
+        ctx->tx.aggr.port_offset = 0;
+        ctx->tx.aggr.frames = 0;
+        ctx->tx.aggr.frame_left = 0;
         return OS_ERROR_GENERIC;
     }
 
-    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data();
+    Debug_ASSERT(len_written <= len_to_write);
+    if (len_written == len_to_write)
+    {
+        ctx->tx.aggr.port_offset = 0;
+        ctx->tx.aggr.frames = 0;
+        ctx->tx.aggr.frame_left = 0;
+        return OS_SUCCESS;
+    }
+
+    Debug_LOG_WARNING("ChanMuxRpc_write() wrote only %zu of %zu bytes",
+                      len_written, len_to_write);
+    ctx->stats->tx_partial_writes++;
+
+    // count the frames written completely, the first one may be left from an
+    // earlier partial write
+    size_t end = ctx->tx.aggr.frame_left;
+    if (0 == end)
+    {
+        end = 2 + (((size_t)port_buffer[0] << 8) | port_buffer[1]);
+    }
+    while (end <= len_written)
+    {
+        ctx->tx.aggr.frames--;
+        end += 2 + (((size_t)port_buffer[end] << 8) | port_buffer[end + 1]);
+    }
+
+    ctx->tx.aggr.frame_left = end - len_written;
+    ctx->tx.aggr.port_offset = len_to_write - len_written;
+    memmove(port_buffer, &port_buffer[len_written], ctx->tx.aggr.port_offset);
+    return OS_ERROR_TRY_AGAIN;
+}
+
+//------------------------------------------------------------------------------
+static bool
+tx_aggr_is_expired(
+    const chanmux_nic_drv_t *ctx)
+{
+    uint64_t deadline_ns = get_tx_aggregate_deadline_ns(ctx);
+    uint64_t now_ns;
+    if ((0 == ctx->tx.aggr.frames) || (0 == deadline_ns) || !get_time_ns(ctx, &now_ns))
+    {
+        return false;
+    }
+
+    return ((now_ns - ctx->tx.aggr.first_frame_ns) >= deadline_ns);
+}
+
+//------------------------------------------------------------------------------
+// Take the room for a frame in the ChanMUX write port and put the length
+// prefix there, the caller puts the frame data at *dst. Returns
+// OS_ERROR_BUFFER_TOO_SMALL if the frame does not fit into an empty port and
+// OS_ERROR_TRY_AGAIN if data ChanMUX did not take leaves no room for it.
+static OS_Error_t
+tx_aggr_reserve(
+    chanmux_nic_drv_t *ctx,
+    size_t len,
+    uint8_t **dst)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
     uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
     size_t port_size = OS_Dataport_getSize(data->port.write);
-    size_t port_offset = 0;
+    size_t frame_size = 2 + len;
 
-    const OS_SharedBuffer_t *nw_output = get_network_stack_port_from();
-    uint8_t *buffer_nw_out = (uint8_t *)nw_output->buffer;
-    size_t offset_nw_out = 0;
+    if (frame_size > port_size)
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
 
-    // send frame length as uint16 in big endian
-    Debug_ASSERT(port_size >= 2);
-    port_buffer[port_offset++] = (len >> 8) & 0xFF;
-    port_buffer[port_offset++] = len & 0xFF;
-    port_size -= 2;
+    // flush if an old batch has expired or the port is full
+    if (tx_aggr_is_expired(ctx) || (frame_size > port_size - ctx->tx.aggr.port_offset))
+    {
+        OS_Error_t err = tx_aggr_flush(ctx);
+        if ((err != OS_SUCCESS) &&
+            ((err != OS_ERROR_TRY_AGAIN) ||
+             (frame_size > port_size - ctx->tx.aggr.port_offset)))
+        {
+            return err;
+        }
+    }
 
-    size_t remain_len = len;
-    while (remain_len > 0)
+    // frame length as uint16 in big endian, then the frame data
+    uint8_t *p = &port_buffer[ctx->tx.aggr.port_offset];
+    p[0] = (len >> 8) & 0xFF;
+    p[1] = len & 0xFF;
+    *dst = &p[2];
+
+    if (0 == ctx->tx.aggr.frames)
     {
-        size_t len_chunk = remain_len;
-        if (len_chunk > port_size)
+        ctx->tx.aggr.first_frame_ns = 0;
+        (void)get_time_ns(ctx, &ctx->tx.aggr.first_frame_ns);
+    }
+    ctx->tx.aggr.port_offset += frame_size;
+    ctx->tx.aggr.frames++;
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Add a frame to the ChanMUX write port. Returns OS_ERROR_BUFFER_TOO_SMALL if
+// the frame does not fit into an empty port, the caller must send it directly
+// then.
+static OS_Error_t
+tx_aggr_add_frame(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *frame,
+    size_t len)
+{
+    uint8_t *dst;
+    OS_Error_t err = tx_aggr_reserve(ctx, len, &dst);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+    tx_csum_copy(ctx, dst, frame, len);
+
+    // the frame is taken, also if a part of the port is left for later
+    if (ctx->tx.aggr.frames >= get_tx_aggregate_max_frames(ctx))
+    {
+        err = tx_aggr_flush(ctx);
+        return (OS_ERROR_TRY_AGAIN == err) ? OS_SUCCESS : err;
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// TX queue, frames are kept in ring buffers in the ChanMUX stream format and
+// written from there. Whatever ChanMUX does not take stays queued, so a
+// partial write continues from where it stopped. Each priority class has a
+// ring of its own, the scheduler picks the class of the next frame.
+//------------------------------------------------------------------------------
+static void
+tx_queue_update_stats(
+    chanmux_nic_drv_t *ctx)
+{
+    size_t used = 0;
+    unsigned int frames = 0;
+    for (unsigned int i = 0; i < ctx->tx.queue.classes; i++)
+    {
+        used += ctx->tx.queue.q[i].used;
+        frames += ctx->tx.queue.q[i].frames;
+    }
+
+    ctx->stats->tx_queue_bytes = used;
+    ctx->stats->tx_queue_frames = frames;
+    if (used > ctx->stats->tx_queue_peak)
+    {
+        ctx->stats->tx_queue_peak = used;
+    }
+}
+
+//------------------------------------------------------------------------------
+static bool
+tx_queue_is_empty(
+    const chanmux_nic_drv_t *ctx)
+{
+    for (unsigned int i = 0; i < ctx->tx.queue.classes; i++)
+    {
+        if (0 != ctx->tx.queue.q[i].used)
         {
-            len_chunk = port_size;
-            Debug_LOG_WARNING("can only send %zu of %zu bytes",
-                              len_chunk, remain_len);
+            return false;
         }
+    }
 
-        // copy data from network stack to ChanMUX buffer
-        memcpy(&port_buffer[port_offset],
-               &buffer_nw_out[offset_nw_out],
-               len_chunk);
+    return true;
+}
 
-        // tell ChanMUX how much data is there. We have to take into account
-        // the frame length prefix.
-        size_t len_to_write = port_offset + len_chunk;
+//------------------------------------------------------------------------------
+// get the bytes in all TX queues
+static size_t
+tx_queue_get_used(
+    const chanmux_nic_drv_t *ctx)
+{
+    size_t used = 0;
+    for (unsigned int i = 0; i < ctx->tx.queue.classes; i++)
+    {
+        used += ctx->tx.queue.q[i].used;
+    }
+
+    return used;
+}
+
+//------------------------------------------------------------------------------
+// get the byte at an offset from the queue tail
+static uint8_t
+tx_queue_peek(
+    const chanmux_nic_drv_tx_queue_t *q,
+    size_t offset)
+{
+    return q->buffer[(q->tail + offset) % q->size];
+}
+
+//------------------------------------------------------------------------------
+// get the size of the frame starting at an offset from the queue tail
+static size_t
+tx_queue_frame_size(
+    const chanmux_nic_drv_tx_queue_t *q,
+    size_t offset)
+{
+    return 2 + (((size_t)tx_queue_peek(q, offset) << 8) |
+                tx_queue_peek(q, offset + 1));
+}
+
+//------------------------------------------------------------------------------
+static void
+tx_queue_put(
+    chanmux_nic_drv_tx_queue_t *q,
+    const uint8_t *data,
+    size_t len)
+{
+    size_t len_chunk = q->size - q->head;
+    if (len_chunk > len)
+    {
+        len_chunk = len;
+    }
+    memcpy(&q->buffer[q->head], data, len_chunk);
+    memcpy(q->buffer, &data[len_chunk], len - len_chunk);
+    q->head = (q->head + len) % q->size;
+    q->used += len;
+}
+
+//------------------------------------------------------------------------------
+// copy data at an offset from the queue tail
+static void
+tx_queue_get(
+    const chanmux_nic_drv_tx_queue_t *q,
+    size_t offset,
+    uint8_t *data,
+    size_t len)
+{
+    size_t pos = (q->tail + offset) % q->size;
+    size_t len_chunk = q->size - pos;
+    if (len_chunk > len)
+    {
+        len_chunk = len;
+    }
+    memcpy(data, &q->buffer[pos], len_chunk);
+    memcpy(&data[len_chunk], q->buffer, len - len_chunk);
+}
+
+//------------------------------------------------------------------------------
+// Put a frame into a priority class. ARP and ICMP keep the link usable, VLAN
+// tagged frames bring their priority, small frames are mostly TCP ACKs.
+static unsigned int
+tx_queue_classify(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *frame,
+    size_t len)
+{
+    const unsigned int classes = ctx->tx.queue.classes;
+    if ((classes <= 1) || (len < ETH_HDR_LEN))
+    {
+        return 0;
+    }
+
+    const chanmux_nic_drv_config_t *config = ctx->config;
+    unsigned int cls = config->tx.queue.default_class;
+    size_t l3 = ETH_HDR_LEN;
+    uint16_t ethertype = ((uint16_t)frame[12] << 8) | frame[13];
+    bool tagged = ((ETHERTYPE_VLAN == ethertype) &&
+                   (len >= ETH_HDR_LEN + ETH_VLAN_TAG_LEN));
+    if (tagged)
+    {
+        // the priority code point is in the top 3 bits of the tag
+        cls = config->tx.queue.pcp_class[frame[14] >> 5];
+        ethertype = ((uint16_t)frame[16] << 8) | frame[17];
+        l3 += ETH_VLAN_TAG_LEN;
+    }
+
+    if ((ETHERTYPE_ARP == ethertype) ||
+        ((ETHERTYPE_IPV4 == ethertype) && (len > l3 + 9) &&
+         (IP_PROTO_ICMP == frame[l3 + 9])) ||
+        ((ETHERTYPE_IPV6 == ethertype) && (len > l3 + 6) &&
+         (IP_PROTO_ICMPV6 == frame[l3 + 6])))
+    {
+        cls = config->tx.queue.control_class;
+    }
+    else if (!tagged && (len <= config->tx.queue.small_len))
+    {
+        cls = config->tx.queue.small_class;
+    }
+
+    return (cls < classes) ? cls : (classes - 1);
+}
+
+//------------------------------------------------------------------------------
+// Pick the class of the next frame, planned holds the bytes already taken from
+// each class. Class 0 goes first always, the others get a quantum of bytes per
+// round (deficit round robin). Returns CHANMUX_NIC_DRV_TX_CLASSES_MAX if all
+// queues are empty.
+static unsigned int
+tx_queue_pick(
+    const chanmux_nic_drv_t *ctx,
+    chanmux_nic_drv_tx_sched_t *sched,
+    const size_t *planned)
+{
+    const unsigned int classes = ctx->tx.queue.classes;
+    const chanmux_nic_drv_tx_queue_t *q = ctx->tx.queue.q;
+
+    if (q[0].used > planned[0])
+    {
+        return 0;
+    }
+
+    bool pending = false;
+    for (unsigned int i = 1; i < classes; i++)
+    {
+        pending = pending || (q[i].used > planned[i]);
+    }
+    if (!pending)
+    {
+        return CHANMUX_NIC_DRV_TX_CLASSES_MAX;
+    }
+
+    // terminates, as each round adds a quantum to the classes with frames
+    for (;;)
+    {
+        unsigned int i = sched->rr;
+        if (q[i].used > planned[i])
+        {
+            size_t frame_size = tx_queue_frame_size(&q[i], planned[i]);
+            if (frame_size <= sched->deficit[i])
+            {
+                sched->deficit[i] -= frame_size;
+                return i;
+            }
+        }
+        else
+        {
+            // an idle class can't save up
+            sched->deficit[i] = 0;
+        }
+
+        sched->rr = (i + 1 < classes) ? (i + 1) : 1;
+        sched->deficit[sched->rr] += ctx->tx.queue.q[sched->rr].quantum;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Copy queued data into the ChanMUX write port in the order the scheduler
+// picks the frames, as much as fits and not more frames than the peer takes in
+// one write. A partly written frame is completed first. Returns the number of
+// bytes. The scheduler state is not changed, tx_queue_consume() does this for
+// the data ChanMUX has taken.
+static size_t
+tx_queue_fill_port(
+    const chanmux_nic_drv_t *ctx,
+    uint8_t *port_buffer,
+    size_t port_size)
+{
+    unsigned int max_frames = get_caps(ctx)->max_batch_frames;
+    chanmux_nic_drv_tx_sched_t sched = ctx->tx.queue.sched;
+    size_t planned[CHANMUX_NIC_DRV_TX_CLASSES_MAX] = {0};
+    unsigned int cls = ctx->tx.queue.current;
+    size_t frame_left = ctx->tx.queue.frame_left;
+    unsigned int frames = (0 != frame_left) ? 1 : 0;
+    size_t len = 0;
+
+    while (len < port_size)
+    {
+        if (0 == frame_left)
+        {
+            if ((0 != max_frames) && (frames >= max_frames))
+            {
+                break;
+            }
+            cls = tx_queue_pick(ctx, &sched, planned);
+            if (CHANMUX_NIC_DRV_TX_CLASSES_MAX == cls)
+            {
+                break;
+            }
+            frame_left = tx_queue_frame_size(&ctx->tx.queue.q[cls],
+                                             planned[cls]);
+            frames++;
+        }
+        size_t len_chunk = port_size - len;
+        if (len_chunk > frame_left)
+        {
+            len_chunk = frame_left;
+        }
+        tx_queue_get(&ctx->tx.queue.q[cls], planned[cls], &port_buffer[len],
+                     len_chunk);
+        planned[cls] += len_chunk;
+        len += len_chunk;
+        frame_left -= len_chunk;
+    }
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+// Remove data ChanMUX has taken from the queues. The scheduler picks the same
+// frames as tx_queue_fill_port() did, so this follows the port content.
+static void
+tx_queue_consume(
+    chanmux_nic_drv_t *ctx,
+    size_t len)
+{
+    static const size_t planned[CHANMUX_NIC_DRV_TX_CLASSES_MAX] = {0};
+
+    while (len > 0)
+    {
+        if (0 == ctx->tx.queue.frame_left)
+        {
+            ctx->tx.queue.current = tx_queue_pick(ctx, &ctx->tx.queue.sched,
+                                                  planned);
+            Debug_ASSERT(ctx->tx.queue.current < ctx->tx.queue.classes);
+            ctx->tx.queue.frame_left = tx_queue_frame_size(
+                                           &ctx->tx.queue.q[ctx->tx.queue.current],
+                                           0);
+        }
+        chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[ctx->tx.queue.current];
+        size_t len_chunk = ctx->tx.queue.frame_left;
+        if (len_chunk > len)
+        {
+            len_chunk = len;
+        }
+        q->tail = (q->tail + len_chunk) % q->size;
+        q->used -= len_chunk;
+        ctx->tx.queue.frame_left -= len_chunk;
+        len -= len_chunk;
+        if (0 == ctx->tx.queue.frame_left)
+        {
+            q->frames--;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Write queued data until ChanMUX takes less than offered or the queues are
+// empty. Returns OS_ERROR_TRY_AGAIN if data is left.
+static OS_Error_t
+tx_queue_drain(
+    chanmux_nic_drv_t *ctx)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
+    size_t port_size = OS_Dataport_getSize(data->port.write);
+    OS_Error_t ret = OS_SUCCESS;
+
+    // the frames added since the last attempt are on their way now
+    ctx->tx.aggr.frames = 0;
+    ctx->tx.queue.retry = false;
+
+    while (!tx_queue_is_empty(ctx))
+    {
+        size_t len_to_write = tx_queue_fill_port(ctx, port_buffer, port_size);
         size_t len_written = 0;
+        ctx->stats->tx_writes++;
         OS_Error_t err = data->func.write(
             data->id,
             len_to_write,
             &len_written);
         if (err != OS_SUCCESS)
         {
-            Debug_LOG_ERROR("ChanMuxRpc_write() failed, error %d", err);
-            return OS_ERROR_GENERIC;
+            // keep the data, dropping a partly written frame would break the
+            // stream for the peer
+            Debug_LOG_ERROR("ChanMuxRpc_write() failed, error %d, keep data "
+                            "queued", err);
+            ctx->tx.queue.retry = true;
+            ret = OS_ERROR_GENERIC;
+            break;
         }
 
         Debug_ASSERT(len_written <= len_to_write);
+        tx_queue_consume(ctx, len_written);
         if (len_written != len_to_write)
         {
-            Debug_LOG_WARNING("ChanMuxRpc_write() wrote only %zu of %zu bytes",
-                              len_written, len_to_write);
-            return OS_ERROR_GENERIC;
+            Debug_LOG_TRACE("ChanMuxRpc_write() wrote only %zu of %zu bytes",
+                            len_written, len_to_write);
+            ctx->stats->tx_partial_writes++;
+            ctx->tx.queue.retry = true;
+            ret = OS_ERROR_TRY_AGAIN;
+            break;
         }
+    }
 
-        // len_written may include the frame length header, but remain_len does
-        // not contain is. Thus we have to use len_chunk here.
-        Debug_ASSERT(remain_len <= len_chunk);
-        remain_len -= len_chunk;
-        offset_nw_out += len_chunk;
+    for (unsigned int i = 0; i < ctx->tx.queue.classes; i++)
+    {
+        chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[i];
+        if (q->stopped && (q->used <= q->low_watermark))
+        {
+            Debug_LOG_TRACE("TX queue %u below low watermark, accept frames "
+                            "again", i);
+            q->stopped = false;
+        }
+    }
+    tx_queue_update_stats(ctx);
 
-        // full port buffer is available again
-        port_offset = 0;
-        port_size = OS_Dataport_getSize(data->port.write);
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+static bool
+tx_queue_is_stopped(
+    const chanmux_nic_drv_t *ctx)
+{
+    for (unsigned int i = 0; i < ctx->tx.queue.classes; i++)
+    {
+        if (ctx->tx.queue.q[i].stopped)
+        {
+            return true;
+        }
     }
 
-    *pLen = len;
-    return OS_SUCCESS;
+    return false;
 }
 
 //------------------------------------------------------------------------------
-// called by network stack to get the MAC
-OS_Error_t
-chanmux_nic_driver_rpc_get_mac(void)
+// With empty queues and no aggregation the frame goes into the ChanMUX write
+// port directly, only what ChanMUX does not take is queued.
+static void
+tx_queue_send_direct(
+    chanmux_nic_drv_t *ctx,
+    unsigned int cls,
+    const uint8_t *frame,
+    size_t len)
 {
-    const ChanMux_ChannelOpsCtx_t *ctrl = get_chanmux_channel_ctrl();
-    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data();
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
 
-    // ChanMUX simulates an ethernet device, get the MAC address from it
-    uint8_t mac[MAC_SIZE] = {0};
-    OS_Error_t err = chanmux_nic_ctrl_get_mac(ctrl, data->id, mac);
+    // frame length as uint16 in big endian, then the frame data
+    port_buffer[0] = (len >> 8) & 0xFF;
+    port_buffer[1] = len & 0xFF;
+    tx_csum_copy(ctx, &port_buffer[2], frame, len);
+
+    size_t len_to_write = 2 + len;
+    size_t len_written = 0;
+    ctx->stats->tx_writes++;
+    OS_Error_t err = data->func.write(
+        data->id,
+        len_to_write,
+        &len_written);
     if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("chanmux_nic_ctrl_get_mac() failed, error %d", err);
+        Debug_LOG_ERROR("ChanMuxRpc_write() failed, error %d, keep frame "
+                        "queued", err);
+        len_written = 0;
+    }
+    else if (len_written != len_to_write)
+    {
+        Debug_LOG_TRACE("ChanMuxRpc_write() wrote only %zu of %zu bytes",
+                        len_written, len_to_write);
+        ctx->stats->tx_partial_writes++;
+    }
+
+    Debug_ASSERT(len_written <= len_to_write);
+    if (len_written != len_to_write)
+    {
+        chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[cls];
+        tx_queue_put(q, &port_buffer[len_written], len_to_write - len_written);
+        q->frames = 1;
+        ctx->tx.queue.current = cls;
+        ctx->tx.queue.frame_left = len_to_write - len_written;
+        ctx->tx.queue.retry = true;
+        tx_queue_update_stats(ctx);
+    }
+}
+
+//------------------------------------------------------------------------------
+static bool
+tx_queue_has_room(
+    chanmux_nic_drv_tx_queue_t *q,
+    size_t frame_size)
+{
+    if (!q->stopped && (frame_size > q->high_watermark - q->used))
+    {
+        Debug_LOG_TRACE("TX queue above high watermark, refuse frames");
+        q->stopped = true;
+    }
+
+    return !q->stopped;
+}
+
+//------------------------------------------------------------------------------
+// Make room for data in a TX queue. The queued data goes first anyway, so the
+// queues are written if it does not fit. Returns OS_ERROR_TRY_AGAIN if the
+// queue is still too full.
+static OS_Error_t
+tx_queue_make_room(
+    chanmux_nic_drv_t *ctx,
+    chanmux_nic_drv_tx_queue_t *q,
+    size_t size)
+{
+    if (!tx_queue_has_room(q, size))
+    {
+        (void)tx_queue_drain(ctx);
+        if (!tx_queue_has_room(q, size))
+        {
+            ctx->stats->tx_queue_stops++;
+            return OS_ERROR_TRY_AGAIN;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Account frames put into the TX queues and write the queues if the
+// aggregation settings say so. The frames are taken, so a failed or partial
+// write is not reported here.
+static void
+tx_queue_commit(
+    chanmux_nic_drv_t *ctx,
+    unsigned int frames)
+{
+    tx_queue_update_stats(ctx);
+
+    if (0 == ctx->tx.aggr.frames)
+    {
+        ctx->tx.aggr.first_frame_ns = 0;
+        (void)get_time_ns(ctx, &ctx->tx.aggr.first_frame_ns);
+    }
+    ctx->tx.aggr.frames += frames;
+
+    if (ctx->tx.queue.retry || tx_aggr_is_expired(ctx) ||
+        (ctx->tx.aggr.frames >= get_tx_aggregate_max_frames(ctx)))
+    {
+        (void)tx_queue_drain(ctx);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Add a frame to the TX queue of its class and write the queues if the
+// aggregation settings say so. Returns OS_ERROR_TRY_AGAIN if the queue is too
+// full to take it.
+static OS_Error_t
+tx_queue_add_frame(
+    chanmux_nic_drv_t *ctx,
+    uint8_t *frame,
+    size_t len)
+{
+    size_t frame_size = 2 + len;
+    unsigned int cls = tx_queue_classify(ctx, frame, len);
+    chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[cls];
+
+    if (frame_size > q->high_watermark)
+    {
+        Debug_LOG_ERROR("frame len %zu exceeds TX queue %u high watermark %zu",
+                        len, cls, q->high_watermark);
         return OS_ERROR_GENERIC;
     }
 
-    // sanity check, the MAC address can't be all zero.
-    const uint8_t empty_mac[MAC_SIZE] = {0};
-    if (memcmp(mac, empty_mac, MAC_SIZE) == 0)
+    OS_Error_t err = tx_queue_make_room(ctx, q, frame_size);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+    ctx->stats->tx_class_frames[cls]++;
+
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    if (tx_queue_is_empty(ctx) && (get_tx_aggregate_max_frames(ctx) <= 1) &&
+        (frame_size <= OS_Dataport_getSize(data->port.write)))
+    {
+        tx_queue_send_direct(ctx, cls, frame, len);
+        return OS_SUCCESS;
+    }
+
+    // frame length as uint16 in big endian, then the frame data. The queue
+    // may wrap within the frame, so the checksums are set before.
+    uint8_t prefix[2] = { (len >> 8) & 0xFF, len & 0xFF };
+    tx_csum_fill(ctx, frame, len);
+    tx_queue_put(q, prefix, sizeof(prefix));
+    tx_queue_put(q, frame, len);
+    q->frames++;
+    tx_queue_commit(ctx, 1);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Write data through the ChanMUX write port, in several chunks if it does not
+// fit. The first port_offset bytes in the port go with the first chunk.
+static OS_Error_t
+tx_write_chunks(
+    chanmux_nic_drv_t *ctx,
+    size_t port_offset,
+    const uint8_t *buffer_nw_out,
+    size_t len)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
+    size_t port_size = OS_Dataport_getSize(data->port.write);
+    size_t offset_nw_out = 0;
+
+    Debug_ASSERT(port_size >= port_offset);
+    port_size -= port_offset;
+
+    size_t remain_len = len;
+    while ((port_offset > 0) || (remain_len > 0))
     {
-        Debug_LOG_ERROR("MAC with all zeros is not allowed");
+        size_t len_chunk = remain_len;
+        if (len_chunk > port_size)
+        {
+            len_chunk = port_size;
+            // a port filled in place already is sent as it is, not a shortfall
+            if (len_chunk > 0)
+            {
+                Debug_LOG_WARNING("can only send %zu of %zu bytes",
+                                  len_chunk, remain_len);
+            }
+        }
+
+        // copy data from network stack to ChanMUX buffer
+        memcpy(&port_buffer[port_offset],
+               &buffer_nw_out[offset_nw_out],
+               len_chunk);
+
+        // tell ChanMUX how much data is there. We have to take into account
+        // the frame length prefix.
+        size_t len_to_write = port_offset + len_chunk;
+        size_t len_written = 0;
+        ctx->stats->tx_writes++;
+        OS_Error_t err = data->func.write(
+            data->id,
+            len_to_write,
+            &len_written);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("ChanMuxRpc_write() failed, error %d", err);
+            return OS_ERROR_GENERIC;
+        }
+
+        Debug_ASSERT(len_written <= len_to_write);
+        if (len_written != len_to_write)
+        {
+            Debug_LOG_WARNING("ChanMuxRpc_write() wrote only %zu of %zu bytes",
+                              len_written, len_to_write);
+            ctx->stats->tx_partial_writes++;
+            return OS_ERROR_GENERIC;
+        }
+
+        // len_written may include the frame length header, but remain_len does
+        // not contain is. Thus we have to use len_chunk here.
+        Debug_ASSERT(len_chunk <= remain_len);
+        remain_len -= len_chunk;
+        offset_nw_out += len_chunk;
+
+        // full port buffer is available again
+        port_offset = 0;
+        port_size = OS_Dataport_getSize(data->port.write);
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Send a frame through the ChanMUX write port, in several chunks if it does
+// not fit. The checksums must be set already.
+static OS_Error_t
+tx_send_chunks(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *buffer_nw_out,
+    size_t len)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
+
+    // send frame length as uint16 in big endian
+    port_buffer[0] = (len >> 8) & 0xFF;
+    port_buffer[1] = len & 0xFF;
+
+    OS_Error_t err = tx_write_chunks(ctx, 2, buffer_nw_out, len);
+    if (err != OS_SUCCESS)
+    {
+        ctx->stats->tx_dropped++;
+    }
+    return err;
+}
+
+//------------------------------------------------------------------------------
+// In TX zero-copy mode the network stack has written the frame into the
+// ChanMUX write port already, leaving room for the length prefix in front. If
+// the network stack output is bigger than the port, a frame may go beyond it.
+// The part in the port is sent in place then, the rest in chunks.
+static OS_Error_t
+tx_send_in_place(
+    chanmux_nic_drv_t *ctx,
+    size_t len)
+{
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    uint8_t *port_buffer = OS_Dataport_getBuf(data->port.write);
+    size_t port_size = OS_Dataport_getSize(data->port.write);
+    const OS_SharedBuffer_t *nw_output = get_network_stack_port_from(ctx);
+
+    if (len > nw_output->len - CHANMUX_NIC_DRV_TX_HEADROOM)
+    {
+        Debug_LOG_ERROR("frame len %zu exceeds port size %zu",
+                        len, nw_output->len - CHANMUX_NIC_DRV_TX_HEADROOM);
         return OS_ERROR_GENERIC;
     }
 
+    // send frame length as uint16 in big endian
+    port_buffer[0] = (len >> 8) & 0xFF;
+    port_buffer[1] = len & 0xFF;
+    tx_csum_fill(ctx, &port_buffer[CHANMUX_NIC_DRV_TX_HEADROOM], len);
+
+    size_t len_in_place = len;
+    if (len_in_place > port_size - CHANMUX_NIC_DRV_TX_HEADROOM)
+    {
+        len_in_place = port_size - CHANMUX_NIC_DRV_TX_HEADROOM;
+    }
+    return tx_write_chunks(
+               ctx,
+               CHANMUX_NIC_DRV_TX_HEADROOM + len_in_place,
+               &port_buffer[CHANMUX_NIC_DRV_TX_HEADROOM + len_in_place],
+               len - len_in_place);
+}
+
+//------------------------------------------------------------------------------
+// send a frame from the network stack output dataport
+static OS_Error_t
+tx_data(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen)
+{
+    size_t len = *pLen;
+    *pLen = 0;
+
+    Debug_LOG_TRACE("sending frame of %zu bytes ", len);
+
+    // Ethernet frames used to be max 1518 bytes. Then 802.1Q added a 4 byte
+    // Q-tag, so they can be 1522 bytes, which is a common default. However,
+    // there is also 802.1ad "Q-in-Q", where multiple Q-tags can be present.
+    // Thus we do not make any assumption here about the max size here and send
+    // whatever the network stack give us. With our 2-byte length prefix, the
+    // length can be up to 0xFFFF, so even jumbo frame with an MTU of 9000 byte
+    // would work.
+    // The peer may announce a lower limit.
+    size_t max_frame_len = get_caps(ctx)->max_frame_len;
+    if (len > max_frame_len)
+    {
+        Debug_LOG_WARNING("can't send frame, len %zu exceeds max supported length %zu",
+                          len, max_frame_len);
+        ctx->stats->tx_dropped++;
+        return OS_ERROR_GENERIC;
+    }
+
+    if (is_tx_zero_copy_enabled(ctx))
+    {
+        OS_Error_t err = tx_send_in_place(ctx, len);
+        if (err == OS_SUCCESS)
+        {
+            *pLen = len;
+            ctx->stats->tx_frames++;
+            ctx->stats->tx_bytes += len;
+        }
+        else
+        {
+            ctx->stats->tx_dropped++;
+        }
+        return err;
+    }
+
+    // if the network stack leaves headroom for the length prefix, the frame
+    // starts behind it.
+    const OS_SharedBuffer_t *nw_output = get_network_stack_port_from(ctx);
+    uint8_t *buffer_nw_out = (uint8_t *)nw_output->buffer + get_tx_headroom(ctx);
+
+    if (is_tx_queue_enabled(ctx))
+    {
+        OS_Error_t err = tx_queue_add_frame(ctx, buffer_nw_out, len);
+        if (err == OS_SUCCESS)
+        {
+            *pLen = len;
+            ctx->stats->tx_frames++;
+            ctx->stats->tx_bytes += len;
+        }
+        else if (err != OS_ERROR_TRY_AGAIN)
+        {
+            ctx->stats->tx_dropped++;
+        }
+        return err;
+    }
+
+    if (get_tx_aggregate_max_frames(ctx) > 1)
+    {
+        OS_Error_t err = tx_aggr_add_frame(ctx, buffer_nw_out, len);
+        if (err != OS_ERROR_BUFFER_TOO_SMALL)
+        {
+            if (err == OS_SUCCESS)
+            {
+                *pLen = len;
+                ctx->stats->tx_frames++;
+                ctx->stats->tx_bytes += len;
+            }
+            return err;
+        }
+
+    }
+
+    // The frame is sent in chunks below, keep the order and send the frames
+    // pending in the port first. Without aggregation, these can only be TSO
+    // segments ChanMUX did not take.
+    OS_Error_t err = tx_aggr_flush(ctx);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    // the frame may be sent in several chunks, so the checksums are set before
+    tx_csum_fill(ctx, buffer_nw_out, len);
+
+    err = tx_send_chunks(ctx, buffer_nw_out, len);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    *pLen = len;
+    ctx->stats->tx_frames++;
+    ctx->stats->tx_bytes += len;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// TX segmentation offload, the network stack hands over a TCP segment bigger
+// than the MSS and the driver splits it. Each segment gets a copy of the
+// headers, the payload sum is taken while the payload is copied.
+//------------------------------------------------------------------------------
+static void
+tx_tso_copy_seg(
+    uint8_t *dst,
+    const uint8_t *frame,
+    const chanmux_nic_tx_tso_t *tso,
+    size_t i)
+{
+    size_t len = chanmux_nic_tx_tso_get_len(tso, i);
+    memcpy(dst, frame, tso->hdr_len);
+    uint64_t sum = chanmux_nic_csum_copy(&dst[tso->hdr_len],
+                                         &frame[tso->hdr_len + i * tso->mss],
+                                         len - tso->hdr_len, 0);
+    chanmux_nic_tx_tso_set_hdr(tso, dst, i, sum);
+}
+
+//------------------------------------------------------------------------------
+// Pack the segments into the ChanMUX write port. Without aggregation, they
+// are written together at the end, as far as the peer takes them in one
+// write.
+static OS_Error_t
+tx_tso_aggr(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *frame,
+    const chanmux_nic_tx_tso_t *tso)
+{
+    unsigned int max_frames = get_tx_aggregate_max_frames(ctx);
+    const bool isAggregating = (max_frames > 1);
+    if (!isAggregating)
+    {
+        max_frames = get_caps(ctx)->max_batch_frames;
+    }
+
+    for (size_t i = 0; i < tso->segs; i++)
+    {
+        // the segments in the port are counted by tx_aggr_flush() if writing
+        // fails, the ones behind them here. Once a segment is taken, the
+        // network stack must not send them again, so data ChanMUX did not
+        // take is retried as long as it takes some.
+        uint8_t *dst;
+        OS_Error_t err;
+        size_t port_offset;
+        do
+        {
+            port_offset = ctx->tx.aggr.port_offset;
+            err = tx_aggr_reserve(ctx, chanmux_nic_tx_tso_get_len(tso, i), &dst);
+        }
+        while ((OS_ERROR_TRY_AGAIN == err) && (i > 0) &&
+               (ctx->tx.aggr.port_offset < port_offset));
+        if ((OS_ERROR_TRY_AGAIN == err) && (0 == i))
+        {
+            return err;
+        }
+        if (err != OS_SUCCESS)
+        {
+            ctx->stats->tx_dropped += tso->segs - i;
+            return OS_ERROR_GENERIC;
+        }
+        tx_tso_copy_seg(dst, frame, tso, i);
+
+        if ((0 != max_frames) && (ctx->tx.aggr.frames >= max_frames))
+        {
+            err = tx_aggr_flush(ctx);
+            if ((err != OS_SUCCESS) && (err != OS_ERROR_TRY_AGAIN))
+            {
+                ctx->stats->tx_dropped += tso->segs - i - 1;
+                return err;
+            }
+        }
+    }
+
+    OS_Error_t err = isAggregating ? OS_SUCCESS : tx_aggr_flush(ctx);
+    return (OS_ERROR_TRY_AGAIN == err) ? OS_SUCCESS : err;
+}
+//------------------------------------------------------------------------------
+// Segments that do not fit into the ChanMUX write port are set up in place and
+// sent in chunks. The headers of a segment go over the end of the payload in
+// front of it, which is sent already.
+static OS_Error_t
+tx_tso_chunks(
+    chanmux_nic_drv_t *ctx,
+    uint8_t *frame,
+    const chanmux_nic_tx_tso_t *tso)
+{
+    // keep the order, the pending frames go first
+    OS_Error_t err = tx_aggr_flush(ctx);
+    if (err != OS_SUCCESS)
+    {
+        if (err != OS_ERROR_TRY_AGAIN)
+        {
+            ctx->stats->tx_dropped += tso->segs;
+        }
+        return err;
+    }
+
+    uint8_t hdr[CHANMUX_NIC_TX_TSO_HDR_MAX];
+    memcpy(hdr, frame, tso->hdr_len);
+    for (size_t i = 0; i < tso->segs; i++)
+    {
+        uint8_t *seg = &frame[i * tso->mss];
+        size_t len = chanmux_nic_tx_tso_get_len(tso, i);
+        memcpy(seg, hdr, tso->hdr_len);
+        chanmux_nic_tx_tso_set_hdr(tso, seg, i,
+                                   chanmux_nic_csum_partial(&seg[tso->hdr_len],
+                                                            len - tso->hdr_len,
+                                                            0));
+        err = tx_send_chunks(ctx, seg, len);
+        if (err != OS_SUCCESS)
+        {
+            // the segment that failed is counted already
+            ctx->stats->tx_dropped += tso->segs - i - 1;
+            return err;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Put a segment into a TX queue. The queue may wrap within the segment, so the
+// payload sum needs a pass of its own.
+static void
+tx_tso_queue_seg(
+    chanmux_nic_drv_tx_queue_t *q,
+    const uint8_t *frame,
+    const chanmux_nic_tx_tso_t *tso,
+    size_t i)
+{
+    // frame length as uint16 in big endian, then the headers and the payload
+    uint8_t hdr[2 + CHANMUX_NIC_TX_TSO_HDR_MAX];
+    size_t len = chanmux_nic_tx_tso_get_len(tso, i);
+    const uint8_t *payload = &frame[tso->hdr_len + i * tso->mss];
+    hdr[0] = (len >> 8) & 0xFF;
+    hdr[1] = len & 0xFF;
+    memcpy(&hdr[2], frame, tso->hdr_len);
+    chanmux_nic_tx_tso_set_hdr(tso, &hdr[2], i,
+                               chanmux_nic_csum_partial(payload,
+                                                        len - tso->hdr_len, 0));
+    tx_queue_put(q, hdr, 2 + tso->hdr_len);
+    tx_queue_put(q, payload, len - tso->hdr_len);
+    q->frames++;
+}
+
+//------------------------------------------------------------------------------
+// Put the segments into the TX queue of the class the first one has, none if
+// the queue is too full, then it returns OS_ERROR_TRY_AGAIN. Segments above
+// the high watermark are queued in parts, each part is written before the
+// next one is put. If ChanMUX takes nothing meanwhile, the rest is dropped.
+static OS_Error_t
+tx_tso_queue(
+    chanmux_nic_drv_t *ctx,
+    uint8_t *frame,
+    const chanmux_nic_tx_tso_t *tso)
+{
+    size_t size = tso->segs * (2 + tso->hdr_len) + tso->payload_len;
+    unsigned int cls = tx_queue_classify(ctx, frame,
+                                         chanmux_nic_tx_tso_get_len(tso, 0));
+    chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[cls];
+
+    if (size > q->high_watermark)
+    {
+        size = 2 + chanmux_nic_tx_tso_get_len(tso, 0);
+    }
+    OS_Error_t err = tx_queue_make_room(ctx, q, size);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+    ctx->stats->tx_class_frames[cls] += tso->segs;
+
+    unsigned int frames = 0;
+    for (size_t i = 0; i < tso->segs; i++)
+    {
+        // once a segment is taken, the others must follow, so the queue is
+        // written as long as ChanMUX takes data
+        size_t seg_size = 2 + chanmux_nic_tx_tso_get_len(tso, i);
+        if (seg_size > q->high_watermark - q->used)
+        {
+            tx_queue_commit(ctx, frames);
+            frames = 0;
+        }
+        while (seg_size > q->high_watermark - q->used)
+        {
+            size_t used = tx_queue_get_used(ctx);
+            (void)tx_queue_drain(ctx);
+            if (tx_queue_get_used(ctx) == used)
+            {
+                Debug_LOG_WARNING("TX queue %u does not drain, drop %zu TSO "
+                                  "segments", cls, tso->segs - i);
+                ctx->stats->tx_dropped += tso->segs - i;
+                return OS_ERROR_GENERIC;
+            }
+        }
+        tx_tso_queue_seg(q, frame, tso, i);
+        frames++;
+    }
+    tx_queue_commit(ctx, frames);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// send a TCP segment from the network stack output dataport, split into
+// segments of at most mss bytes payload
+static OS_Error_t
+tx_tso(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen,
+    size_t mss)
+{
+    size_t len = *pLen;
+
+    if (is_tx_zero_copy_enabled(ctx))
+    {
+        Debug_LOG_ERROR("TSO not possible in TX zero-copy mode");
+        *pLen = 0;
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    // the frame starts behind the headroom, like in tx_data()
+    const OS_SharedBuffer_t *nw_output = get_network_stack_port_from(ctx);
+    size_t headroom = get_tx_headroom(ctx);
+    uint8_t *frame = (uint8_t *)nw_output->buffer + headroom;
+    if (len + headroom > nw_output->len)
+    {
+        Debug_LOG_ERROR("TSO len %zu exceeds port size %zu", len,
+                        nw_output->len - headroom);
+        *pLen = 0;
+        ctx->stats->tx_dropped++;
+        return OS_ERROR_GENERIC;
+    }
+
+    // anything else is sent as it is
+    chanmux_nic_tx_tso_t tso;
+    if (!chanmux_nic_tx_tso_init(&tso, frame, len, mss))
+    {
+        return tx_data(ctx, pLen);
+    }
+    *pLen = 0;
+
+    Debug_LOG_TRACE("splitting TCP segment of %zu bytes into %zu segments",
+                    len, tso.segs);
+
+    size_t seg_len = chanmux_nic_tx_tso_get_len(&tso, 0);
+    size_t max_frame_len = get_caps(ctx)->max_frame_len;
+    if (seg_len > max_frame_len)
+    {
+        Debug_LOG_WARNING("can't send TSO segments, len %zu exceeds max "
+                          "supported length %zu", seg_len, max_frame_len);
+        ctx->stats->tx_dropped += tso.segs;
+        return OS_ERROR_GENERIC;
+    }
+
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
+    OS_Error_t err;
+    if (is_tx_queue_enabled(ctx))
+    {
+        err = tx_tso_queue(ctx, frame, &tso);
+    }
+    else if (2 + seg_len <= OS_Dataport_getSize(data->port.write))
+    {
+        err = tx_tso_aggr(ctx, frame, &tso);
+    }
+    else
+    {
+        err = tx_tso_chunks(ctx, frame, &tso);
+    }
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    *pLen = len;
+    ctx->stats->tx_tso_frames++;
+    ctx->stats->tx_frames += tso.segs;
+    ctx->stats->tx_bytes += tso.segs * tso.hdr_len + tso.payload_len;
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// called by network stack to send an ethernet frame
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_data(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen)
+{
+    uint64_t trace_ns = latency_now(ctx);
+    OS_Error_t err = tx_data(ctx, pLen);
+    (void)latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_TX, trace_ns);
+    return err;
+}
+
+//------------------------------------------------------------------------------
+// called by network stack to send a TCP segment bigger than the MSS
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_data_tso(
+    chanmux_nic_drv_t *ctx,
+    size_t *pLen,
+    size_t mss)
+{
+    uint64_t trace_ns = latency_now(ctx);
+    OS_Error_t err = tx_tso(ctx, pLen, mss);
+    (void)latency_record(ctx, CHANMUX_NIC_DRV_LATENCY_TX, trace_ns);
+    return err;
+}
+
+//------------------------------------------------------------------------------
+// called by network stack to send all aggregated frames immediately
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_flush(
+    chanmux_nic_drv_t *ctx)
+{
+    if (is_tx_queue_enabled(ctx))
+    {
+        return tx_queue_drain(ctx);
+    }
+
+    return tx_aggr_flush(ctx);
+}
+
+//------------------------------------------------------------------------------
+// called periodically by network stack to send aggregated frames that have
+// exceeded the flush deadline
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_tx_poll(
+    chanmux_nic_drv_t *ctx)
+{
+    if (is_tx_queue_enabled(ctx))
+    {
+        OS_Error_t err = OS_SUCCESS;
+        if (ctx->tx.queue.retry || tx_aggr_is_expired(ctx))
+        {
+            err = tx_queue_drain(ctx);
+        }
+        // tell the network stack to hold back frames while the queue drains
+        if (tx_queue_is_stopped(ctx))
+        {
+            return OS_ERROR_TRY_AGAIN;
+        }
+        return (OS_ERROR_TRY_AGAIN == err) ? OS_SUCCESS : err;
+    }
+
+    // data ChanMUX did not take is retried also before the deadline
+    if ((0 == ctx->tx.aggr.frame_left) && !tx_aggr_is_expired(ctx))
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_Error_t err = tx_aggr_flush(ctx);
+    return (OS_ERROR_TRY_AGAIN == err) ? OS_SUCCESS : err;
+}
+
+//------------------------------------------------------------------------------
+// called by network stack to get the MAC
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_get_mac(
+    chanmux_nic_drv_t *ctx)
+{
+    // ChanMUX simulates an ethernet device, the MAC address is read when the
+    // channel is opened. Ask again only if this failed.
+    const chanmux_nic_drv_caps_t *caps = get_caps(ctx);
+    if (!caps->mac_valid)
+    {
+        uint8_t mac[MAC_SIZE] = {0};
+        OS_Error_t err = chanmux_nic_ctrl_get_mac(ctx, mac);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("chanmux_nic_ctrl_get_mac() failed, error %d", err);
+            return (OS_ERROR_TIMEOUT == err) ? err : OS_ERROR_GENERIC;
+        }
+
+        // sanity check, the MAC address can't be all zero.
+        if (!caps->mac_valid)
+        {
+            Debug_LOG_ERROR("MAC with all zeros is not allowed");
+            return OS_ERROR_GENERIC;
+        }
+    }
+    const uint8_t *mac = caps->mac;
+
     Debug_LOG_INFO("MAC is %02x:%02x:%02x:%02x:%02x:%02x",
                    mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 
-    const OS_SharedBuffer_t *nw_input = get_network_stack_port_to();
+    const OS_SharedBuffer_t *nw_input = get_network_stack_port_to(ctx);
     OS_NetworkStack_RxBuffer_t *nw_rx = (OS_NetworkStack_RxBuffer_t *)
                                             nw_input->buffer;
     memcpy(nw_rx->data, mac, MAC_SIZE);
 
     return OS_SUCCESS;
 }
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_set_rx_filter(
+    chanmux_nic_drv_t *ctx,
+    uint32_t flags,
+    uint64_t mcast_hash)
+{
+    if (!is_rx_filter_enabled(ctx))
+    {
+        Debug_LOG_ERROR("RX filter not enabled");
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    ctx->rx.filter.mcast_hash = mcast_hash;
+    ctx->rx.filter.flags = flags;
+    Debug_LOG_INFO("RX filter flags 0x%x, multicast hash 0x%016llx",
+                   (unsigned int)flags, (unsigned long long)mcast_hash);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+uint64_t
+chanmux_nic_driver_mcast_hash(
+    const uint8_t *mac)
+{
+    uint32_t crc = chanmux_nic_crc32_final(chanmux_nic_crc32_update(
+                                               CHANMUX_NIC_CRC32_INIT,
+                                               mac,
+                                               MAC_SIZE));
+    return (uint64_t)1 << (crc & 0x3F);
+}
+
+//------------------------------------------------------------------------------
+// called by a monitoring component to get the driver statistics
+OS_Error_t
+chanmux_nic_driver_ctx_rpc_get_stats(
+    const chanmux_nic_drv_t *ctx,
+    chanmux_nic_drv_stats_t *stats)
+{
+    if (NULL == stats)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memcpy(stats, ctx->stats, sizeof(*stats));
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_tx_data(
+    size_t *pLen)
+{
+    return chanmux_nic_driver_ctx_rpc_tx_data(get_default_ctx(), pLen);
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_tx_data_tso(
+    size_t *pLen,
+    size_t mss)
+{
+    return chanmux_nic_driver_ctx_rpc_tx_data_tso(get_default_ctx(), pLen, mss);
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_tx_flush(void)
+{
+    return chanmux_nic_driver_ctx_rpc_tx_flush(get_default_ctx());
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_tx_poll(void)
+{
+    return chanmux_nic_driver_ctx_rpc_tx_poll(get_default_ctx());
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_get_mac(void)
+{
+    return chanmux_nic_driver_ctx_rpc_get_mac(get_default_ctx());
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_set_rx_filter(
+    uint32_t flags,
+    uint64_t mcast_hash)
+{
+    return chanmux_nic_driver_ctx_rpc_set_rx_filter(get_default_ctx(), flags,
+                                                    mcast_hash);
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_rpc_get_stats(
+    chanmux_nic_drv_stats_t *stats)
+{
+    return chanmux_nic_driver_ctx_rpc_get_stats(get_default_ctx(), stats);
+}
@@ -10,48 +10,182 @@
 
 #include "OS_Error.h"
 #include "ChanMux/ChanMuxCommon.h"
+#include "chanmux_nic_drv_api.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+//------------------------------------------------------------------------------
+// features and offloads this driver implements
+#define CHANMUX_NIC_DRV_FEATURES_SUPPORTED  CHANMUX_NIC_FEATURE_RX_FRAMING_V2
+#define CHANMUX_NIC_DRV_OFFLOADS_SUPPORTED  0
+
+//------------------------------------------------------------------------------
+// Ethernet and IP header fields the driver looks at
+#define ETH_HDR_LEN             14
+#define ETH_VLAN_TAG_LEN        4
+#define ETHERTYPE_IPV4          0x0800
+#define ETHERTYPE_ARP           0x0806
+#define ETHERTYPE_VLAN          0x8100
+#define ETHERTYPE_IPV6          0x86DD
+#define IP_PROTO_ICMP           1
+#define IP_PROTO_TCP            6
+#define IP_PROTO_UDP            17
+#define IP_PROTO_ICMPV6         58
+#define TCP_FLAG_FIN            0x01
+#define TCP_FLAG_SYN            0x02
+#define TCP_FLAG_RST            0x04
+#define TCP_FLAG_PSH            0x08
+#define TCP_FLAG_ACK            0x10
+#define TCP_FLAG_URG            0x20
+#define TCP_FLAG_CWR            0x80
+
+//------------------------------------------------------------------------------
+// read header fields in network byte order
+static inline uint16_t
+get_be16(
+    const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+get_be32(
+    const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
 //------------------------------------------------------------------------------
 // Configuration Wrappers
 //------------------------------------------------------------------------------
-const ChanMux_ChannelOpsCtx_t *get_chanmux_channel_ctrl(void);
-const ChanMux_ChannelOpsCtx_t *get_chanmux_channel_data(void);
-void chanmux_channel_data_wait(void);
-void chanmux_channel_ctrl_wait(void);
-OS_Error_t chanmux_channel_ctrl_mutex_lock(void);
-OS_Error_t chanmux_channel_ctrl_mutex_unlock(void);
-const OS_SharedBuffer_t *get_network_stack_port_to(void);
-const OS_SharedBuffer_t *get_network_stack_port_from(void);
-void network_stack_notify(void);
+const ChanMux_ChannelOpsCtx_t *get_chanmux_channel_ctrl(const chanmux_nic_drv_t *ctx);
+const ChanMux_ChannelOpsCtx_t *get_chanmux_channel_data(const chanmux_nic_drv_t *ctx);
+void chanmux_channel_data_wait(const chanmux_nic_drv_t *ctx);
+bool has_chanmux_channel_data_read_blocking(const chanmux_nic_drv_t *ctx);
+OS_Error_t chanmux_channel_data_read_blocking(const chanmux_nic_drv_t *ctx,
+                                              size_t len, size_t *len_read);
+void chanmux_channel_ctrl_wait(const chanmux_nic_drv_t *ctx);
+void chanmux_channel_ctrl_wait_timeout(const chanmux_nic_drv_t *ctx,
+                                       uint64_t timeout_ns);
+bool chanmux_channel_ctrl_rsp_wait(const chanmux_nic_drv_t *ctx);
+void chanmux_channel_ctrl_rsp_notify(const chanmux_nic_drv_t *ctx);
+OS_Error_t chanmux_channel_ctrl_mutex_lock(const chanmux_nic_drv_t *ctx);
+OS_Error_t chanmux_channel_ctrl_mutex_unlock(const chanmux_nic_drv_t *ctx);
+const OS_SharedBuffer_t *get_network_stack_port_to(const chanmux_nic_drv_t *ctx);
+const OS_SharedBuffer_t *get_network_stack_port_from(const chanmux_nic_drv_t *ctx);
+void network_stack_notify(const chanmux_nic_drv_t *ctx, unsigned int client);
+bool has_network_stack_rx_slot_wait(const chanmux_nic_drv_t *ctx,
+                                    unsigned int client);
+bool network_stack_rx_slot_wait(const chanmux_nic_drv_t *ctx,
+                                unsigned int client);
+bool is_rx_zero_copy_enabled(const chanmux_nic_drv_t *ctx);
+unsigned int get_rx_clients(const chanmux_nic_drv_t *ctx);
+unsigned int get_rx_ring_elements(const chanmux_nic_drv_t *ctx,
+                                  unsigned int client);
+unsigned int get_rx_batch_max_frames(const chanmux_nic_drv_t *ctx);
+bool is_rx_chain_slots_enabled(const chanmux_nic_drv_t *ctx);
+bool is_rx_filter_enabled(const chanmux_nic_drv_t *ctx);
+bool is_rx_csum_offload_enabled(const chanmux_nic_drv_t *ctx);
+size_t get_rx_poll_budget(const chanmux_nic_drv_t *ctx);
+size_t get_rx_lro_max_len(const chanmux_nic_drv_t *ctx);
+uint64_t get_rx_lro_timeout_ns(const chanmux_nic_drv_t *ctx);
+bool is_tx_zero_copy_enabled(const chanmux_nic_drv_t *ctx);
+size_t get_tx_headroom(const chanmux_nic_drv_t *ctx);
+bool is_tx_csum_offload_enabled(const chanmux_nic_drv_t *ctx);
+unsigned int get_tx_aggregate_max_frames(const chanmux_nic_drv_t *ctx);
+uint64_t get_tx_aggregate_deadline_ns(const chanmux_nic_drv_t *ctx);
+bool is_tx_queue_enabled(const chanmux_nic_drv_t *ctx);
+bool get_time_ns(const chanmux_nic_drv_t *ctx, uint64_t *time_ns);
+bool is_ctrl_get_caps_enabled(const chanmux_nic_drv_t *ctx);
+uint64_t get_ctrl_timeout_ns(const chanmux_nic_drv_t *ctx);
+bool is_rx_framing_v2_enabled(const chanmux_nic_drv_t *ctx);
+const chanmux_nic_drv_caps_t *get_caps(const chanmux_nic_drv_t *ctx);
+chanmux_nic_drv_t *get_default_ctx(void);
 
 //------------------------------------------------------------------------------
 // internal functions
 //------------------------------------------------------------------------------
-OS_Error_t chanmux_nic_driver_loop(void);
+OS_Error_t chanmux_nic_driver_loop(chanmux_nic_drv_t *ctx);
+
+/**
+ * @details send a control command without waiting for the response
+ * @ingroup NwChanmuxIf
+ *
+ * Several commands can be in flight, the peer answers them in order.
+ *
+ * @param ctx driver context
+ * @param cmd command
+ * @param cmd_len command length
+ * @param rsp_len expected response length
+ * @param tag receives the tag for chanmux_nic_ctrl_wait_reply()
+ *
+ * @retval OS_ERROR_TRY_AGAIN too many commands in flight
+ * @retval OS_SUCCESS or error code
+ *
+ */
+OS_Error_t
+chanmux_nic_ctrl_submit(
+    chanmux_nic_drv_t *ctx,
+    const uint8_t *cmd,
+    size_t cmd_len,
+    size_t rsp_len,
+    unsigned int *tag);
+
+/**
+ * @details wait for the response to a command
+ * @ingroup NwChanmuxIf
+ *
+ * One caller reads the responses for all commands in flight, the others wait
+ * on ctrl.rsp_wait until it has dispatched something. The reader reads and
+ * dispatches under the control channel mutex, but blocks on the channel event
+ * without it, not beyond the earliest deadline of the pending commands, so
+ * commands can still be sent before earlier responses arrive. If the
+ * response does not arrive within ctrl.timeout_ns, the command is given up.
+ * Its response is still expected and dropped when it arrives, so the
+ * responses to later commands are not mixed up. If only timed out commands are
+ * in flight and the last one timed out a timeout ago, their responses are
+ * considered lost. What the channel has then is dropped and the channel is
+ * resynced, a response that comes even later is taken for the next command.
+ *
+ * @param ctx driver context
+ * @param tag tag from chanmux_nic_ctrl_submit()
+ * @param rsp receives the response
+ * @param rsp_len response length, as passed to chanmux_nic_ctrl_submit()
+ *
+ * @retval OS_ERROR_TIMEOUT no response within ctrl.timeout_ns
+ * @retval OS_SUCCESS or error code
+ *
+ */
+OS_Error_t
+chanmux_nic_ctrl_wait_reply(
+    chanmux_nic_drv_t *ctx,
+    unsigned int tag,
+    uint8_t *rsp,
+    size_t rsp_len);
 
 /**
  * @details open ethernet device simulated via ChanMUX
  * @ingroup NwChanmuxIf
  *
- * @param channel_ctrl control channel
- * @param chan_id_data data channel
+ * The MAC and the link capabilities are read together with the OPEN command
+ * and cached in the context.
+ *
+ * @param ctx driver context
  *
  * @retval OS_SUCCESS or error code
  *
  */
 OS_Error_t
 chanmux_nic_channel_open(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data);
+    chanmux_nic_drv_t *ctx);
 
 /**
  * @details get MAC from ethernet device simulated via ChanMUX
  * @ingroup NwChanmuxIf
  *
- * @param channel_ctrl control channel
- * @param chan_id_data data channel
+ * @param ctx driver context
  * @param mac recevied the MAC
  *
  * @retval OS_SUCCESS or error code
@@ -59,16 +193,13 @@ chanmux_nic_channel_open(
  */
 OS_Error_t
 chanmux_nic_ctrl_get_mac(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data,
+    chanmux_nic_drv_t *ctx,
     uint8_t *mac);
 
 OS_Error_t
 chanmux_nic_ctrl_stopData(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data);
+    chanmux_nic_drv_t *ctx);
 
 OS_Error_t
 chanmux_nic_ctrl_startData(
-    const ChanMux_ChannelOpsCtx_t *channel_ctrl,
-    unsigned int chan_id_data);
+    chanmux_nic_drv_t *ctx);
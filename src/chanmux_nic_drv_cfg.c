@@ -13,16 +13,19 @@
 #include "ChanMux/ChanMuxCommon.h"
 #include "chanmux_nic_drv_api.h"
 #include "chanmux_nic_drv.h"
-#include "chanmux_nic_drv_api.h"
+#include "chanmux_nic_rx_steer.h"
 #include "network/OS_NetworkStackTypes.h"
+#include <string.h>
 
-static const chanmux_nic_drv_config_t *config;
+// context used by the API functions without context parameter
+static chanmux_nic_drv_t default_ctx;
 
 //------------------------------------------------------------------------------
 const ChanMux_ChannelOpsCtx_t *
-get_chanmux_channel_ctrl(void)
+get_chanmux_channel_ctrl(
+    const chanmux_nic_drv_t *ctx)
 {
-    const ChanMux_ChannelOpsCtx_t *channel = &(config->chanmux.ctrl);
+    const ChanMux_ChannelOpsCtx_t *channel = &(ctx->config->chanmux.ctrl);
 
     Debug_ASSERT(NULL != channel);
 
@@ -31,9 +34,10 @@ get_chanmux_channel_ctrl(void)
 
 //------------------------------------------------------------------------------
 OS_Error_t
-chanmux_channel_ctrl_mutex_lock(void)
+chanmux_channel_ctrl_mutex_lock(
+    const chanmux_nic_drv_t *ctx)
 {
-    mutex_lock_func_t lock = config->nic_control_channel_mutex.lock;
+    mutex_lock_func_t lock = ctx->config->nic_control_channel_mutex.lock;
     if (!lock)
     {
         Debug_LOG_ERROR("nic_control_channel_mutex.lock not set");
@@ -52,9 +56,10 @@ chanmux_channel_ctrl_mutex_lock(void)
 
 //------------------------------------------------------------------------------
 OS_Error_t
-chanmux_channel_ctrl_mutex_unlock(void)
+chanmux_channel_ctrl_mutex_unlock(
+    const chanmux_nic_drv_t *ctx)
 {
-    mutex_unlock_func_t unlock = config->nic_control_channel_mutex.unlock;
+    mutex_unlock_func_t unlock = ctx->config->nic_control_channel_mutex.unlock;
     if (!unlock)
     {
         Debug_LOG_ERROR("nic_control_channel_mutex.unlock not set");
@@ -73,9 +78,10 @@ chanmux_channel_ctrl_mutex_unlock(void)
 
 //------------------------------------------------------------------------------
 const ChanMux_ChannelOpsCtx_t *
-get_chanmux_channel_data(void)
+get_chanmux_channel_data(
+    const chanmux_nic_drv_t *ctx)
 {
-    const ChanMux_ChannelOpsCtx_t *channel = &(config->chanmux.data);
+    const ChanMux_ChannelOpsCtx_t *channel = &(ctx->config->chanmux.data);
 
     Debug_ASSERT(NULL != channel);
 
@@ -83,9 +89,9 @@ get_chanmux_channel_data(void)
 }
 
 //------------------------------------------------------------------------------
-void chanmux_channel_data_wait(void)
+void chanmux_channel_data_wait(const chanmux_nic_drv_t *ctx)
 {
-    event_wait_func_t wait = config->chanmux.data.wait;
+    event_wait_func_t wait = ctx->config->chanmux.data.wait;
     if (!wait)
     {
         Debug_LOG_ERROR("chanmux.data.wait() not set");
@@ -96,9 +102,32 @@ void chanmux_channel_data_wait(void)
 }
 
 //------------------------------------------------------------------------------
-void chanmux_channel_ctrl_wait(void)
+bool has_chanmux_channel_data_read_blocking(const chanmux_nic_drv_t *ctx)
+{
+    return (NULL != ctx->config->chanmux.data_read_blocking);
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t chanmux_channel_data_read_blocking(
+    const chanmux_nic_drv_t *ctx,
+    size_t len,
+    size_t *len_read)
 {
-    event_wait_func_t wait = config->chanmux.ctrl.wait;
+    chanmux_nic_drv_read_blocking_func_t read_blocking =
+        ctx->config->chanmux.data_read_blocking;
+    if (!read_blocking)
+    {
+        Debug_LOG_ERROR("chanmux.data_read_blocking() not set");
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    return read_blocking(ctx->config->chanmux.data.id, len, len_read);
+}
+
+//------------------------------------------------------------------------------
+void chanmux_channel_ctrl_wait(const chanmux_nic_drv_t *ctx)
+{
+    event_wait_func_t wait = ctx->config->chanmux.ctrl.wait;
     if (!wait)
     {
         Debug_LOG_ERROR("chanmux.ctrl.wait() not set");
@@ -109,76 +138,593 @@ void chanmux_channel_ctrl_wait(void)
 }
 
 //------------------------------------------------------------------------------
-const OS_SharedBuffer_t *
-get_network_stack_port_to(void)
+void chanmux_channel_ctrl_wait_timeout(
+    const chanmux_nic_drv_t *ctx,
+    uint64_t timeout_ns)
+{
+    // without a timed wait, we can only block until the event arrives
+    chanmux_nic_drv_wait_timeout_func_t wait_timeout =
+        ctx->config->ctrl.wait_timeout;
+    if ((0 == timeout_ns) || !wait_timeout)
+    {
+        chanmux_channel_ctrl_wait(ctx);
+        return;
+    }
+
+    (void)wait_timeout(timeout_ns);
+}
+
+//------------------------------------------------------------------------------
+bool chanmux_channel_ctrl_rsp_wait(const chanmux_nic_drv_t *ctx)
+{
+    // this semaphore is optional, the caller has to fall back to polling if
+    // it is not provided.
+    event_wait_func_t wait = ctx->config->ctrl.rsp_wait;
+    if (!wait)
+    {
+        return false;
+    }
+
+    wait();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void chanmux_channel_ctrl_rsp_notify(const chanmux_nic_drv_t *ctx)
 {
-    Debug_ASSERT(!OS_Dataport_isUnset(config->network_stack.to));
+    event_notify_func_t notify = ctx->config->ctrl.rsp_notify;
+    if (notify)
+    {
+        notify();
+    }
+}
 
-    // TODO: this is a bit hacky, but we try to make things simpler by for the
-    //       caller. And these are constants, so we don't expect any surprises.
-    static OS_SharedBuffer_t s;
-    s.buffer = OS_Dataport_getBuf(config->network_stack.to);
-    s.len = OS_Dataport_getSize(config->network_stack.to);
+//------------------------------------------------------------------------------
+const OS_SharedBuffer_t *
+get_network_stack_port_to(
+    const chanmux_nic_drv_t *ctx)
+{
+    // network stack <- driver (aka input)
+    Debug_ASSERT(NULL != ctx->network_stack_port_to.buffer);
 
-    return &s;
+    return &(ctx->network_stack_port_to);
 }
 
 //------------------------------------------------------------------------------
 const OS_SharedBuffer_t *
-get_network_stack_port_from(void)
+get_network_stack_port_from(
+    const chanmux_nic_drv_t *ctx)
 {
     // network stack -> driver (aka output)
-    Debug_ASSERT(!OS_Dataport_isUnset(config->network_stack.from));
+    Debug_ASSERT(NULL != ctx->network_stack_port_from.buffer);
+
+    return &(ctx->network_stack_port_from);
+}
+
+//------------------------------------------------------------------------------
+bool has_network_stack_rx_slot_wait(
+    const chanmux_nic_drv_t *ctx,
+    unsigned int client)
+{
+    Debug_ASSERT(client < ctx->rx.clients);
+
+    return (NULL != ctx->rx.client[client].rx_slot_wait);
+}
+
+//------------------------------------------------------------------------------
+bool network_stack_rx_slot_wait(
+    const chanmux_nic_drv_t *ctx,
+    unsigned int client)
+{
+    Debug_ASSERT(client < ctx->rx.clients);
+
+    // this signal is optional, the caller has to fall back to polling if the
+    // network stack does not provide it.
+    event_wait_func_t wait = ctx->rx.client[client].rx_slot_wait;
+    if (!wait)
+    {
+        return false;
+    }
+
+    wait();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+unsigned int get_rx_clients(const chanmux_nic_drv_t *ctx)
+{
+    Debug_ASSERT(ctx->rx.clients > 0);
+
+    return ctx->rx.clients;
+}
+
+//------------------------------------------------------------------------------
+unsigned int get_rx_ring_elements(
+    const chanmux_nic_drv_t *ctx,
+    unsigned int client)
+{
+    Debug_ASSERT(client < ctx->rx.clients);
+    Debug_ASSERT(ctx->rx.client[client].ring_elements > 0);
+
+    return ctx->rx.client[client].ring_elements;
+}
+
+//------------------------------------------------------------------------------
+bool is_rx_zero_copy_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->rx.zero_copy;
+}
+
+//------------------------------------------------------------------------------
+unsigned int get_rx_batch_max_frames(const chanmux_nic_drv_t *ctx)
+{
+    // zero is the default if nothing is configured, it behaves like one and
+    // notifies the network stack for every frame.
+    unsigned int batch_max_frames = ctx->config->rx.batch_max_frames;
+
+    return (0 == batch_max_frames) ? 1 : batch_max_frames;
+}
+
+//------------------------------------------------------------------------------
+bool is_rx_chain_slots_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->rx.chain_slots;
+}
+
+//------------------------------------------------------------------------------
+bool is_rx_filter_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->rx.filter.enabled;
+}
+
+//------------------------------------------------------------------------------
+bool is_rx_csum_offload_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->rx.csum_offload;
+}
+
+//------------------------------------------------------------------------------
+size_t get_rx_poll_budget(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->rx.poll_budget;
+}
+
+//------------------------------------------------------------------------------
+size_t get_rx_lro_max_len(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->rx.lro.max_len;
+}
+
+//------------------------------------------------------------------------------
+uint64_t get_rx_lro_timeout_ns(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->rx.lro.timeout_ns;
+}
+
+//------------------------------------------------------------------------------
+bool is_tx_zero_copy_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->tx.zero_copy;
+}
+
+//------------------------------------------------------------------------------
+size_t get_tx_headroom(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->tx.zero_copy ? CHANMUX_NIC_DRV_TX_HEADROOM : 0;
+}
+
+//------------------------------------------------------------------------------
+bool is_tx_csum_offload_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->tx.csum_offload;
+}
 
-    // TODO: this is a bit hacky, but we try to make things simpler by for the
-    //       caller. And these are constants, so we don't expect any surprises.
-    static OS_SharedBuffer_t s;
-    s.buffer = OS_Dataport_getBuf(config->network_stack.from);
-    s.len = OS_Dataport_getSize(config->network_stack.from);
+//------------------------------------------------------------------------------
+unsigned int get_tx_aggregate_max_frames(const chanmux_nic_drv_t *ctx)
+{
+    // in TX zero-copy mode each frame is written into the port directly, so
+    // nothing can be pending there.
+    if (ctx->tx.zero_copy || ctx->tx.aggr.disabled)
+    {
+        return 0;
+    }
 
-    return &s;
+    // the peer may limit the number of frames in one write
+    unsigned int max_frames = ctx->config->tx.aggregate_max_frames;
+    if ((0 != ctx->caps.max_batch_frames) &&
+        (max_frames > ctx->caps.max_batch_frames))
+    {
+        max_frames = ctx->caps.max_batch_frames;
+    }
+    return max_frames;
 }
 
 //------------------------------------------------------------------------------
-void network_stack_notify(void)
+bool is_tx_queue_enabled(const chanmux_nic_drv_t *ctx)
 {
-    event_notify_func_t notify = config->network_stack.notify;
+    return (0 != ctx->tx.queue.classes);
+}
+
+//------------------------------------------------------------------------------
+uint64_t get_tx_aggregate_deadline_ns(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->tx.aggregate_deadline_ns;
+}
+
+//------------------------------------------------------------------------------
+bool get_time_ns(const chanmux_nic_drv_t *ctx, uint64_t *time_ns)
+{
+    // the clock is optional, features that need it are disabled without it.
+    chanmux_nic_drv_get_time_func_t get_time = ctx->config->clock.get_time_ns;
+    if (!get_time)
+    {
+        return false;
+    }
+
+    *time_ns = get_time();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool is_ctrl_get_caps_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->ctrl.get_caps;
+}
+
+//------------------------------------------------------------------------------
+uint64_t get_ctrl_timeout_ns(const chanmux_nic_drv_t *ctx)
+{
+    return ctx->config->ctrl.timeout_ns;
+}
+
+//------------------------------------------------------------------------------
+bool is_rx_framing_v2_enabled(const chanmux_nic_drv_t *ctx)
+{
+    return (0 != (ctx->caps.features & CHANMUX_NIC_FEATURE_RX_FRAMING_V2));
+}
+
+//------------------------------------------------------------------------------
+const chanmux_nic_drv_caps_t *get_caps(const chanmux_nic_drv_t *ctx)
+{
+    return &ctx->caps;
+}
+
+//------------------------------------------------------------------------------
+void network_stack_notify(
+    const chanmux_nic_drv_t *ctx,
+    unsigned int client)
+{
+    Debug_ASSERT(client < ctx->rx.clients);
+
+    event_notify_func_t notify = ctx->rx.client[client].notify;
     if (!notify)
     {
-        Debug_LOG_ERROR("network_stack.notify() not set");
+        Debug_LOG_ERROR("notify() of network stack client %u not set", client);
         return;
     }
 
     notify();
 }
 
+//------------------------------------------------------------------------------
+// Set up the RX ring of a network stack client. The ring depth is either
+// configured explicitly or we use as many slots as fit into the dataport. In
+// both cases the network stack must use the same depth.
+static OS_Error_t
+rx_client_init(
+    chanmux_nic_drv_t *ctx,
+    unsigned int client,
+    const OS_SharedBuffer_t *port,
+    event_notify_func_t notify,
+    event_wait_func_t rx_slot_wait)
+{
+    size_t max_ring_elements = port->len / sizeof(OS_NetworkStack_RxBuffer_t);
+    unsigned int ring_elements = ctx->config->rx.ring_elements;
+    if (0 == ring_elements)
+    {
+        ring_elements = max_ring_elements;
+    }
+    if ((0 == ring_elements) || (ring_elements > max_ring_elements))
+    {
+        Debug_LOG_ERROR("RX ring of client %u with %u slots does not fit into "
+                        "dataport of %zu bytes, max is %zu slots",
+                        client, ring_elements, port->len, max_ring_elements);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    chanmux_nic_drv_rx_client_t *cl = &ctx->rx.client[client];
+    cl->ring = (OS_NetworkStack_RxBuffer_t *)port->buffer;
+    cl->ring_elements = ring_elements;
+    cl->notify = notify;
+    cl->rx_slot_wait = rx_slot_wait;
+    Debug_LOG_INFO("RX ring of client %u has %u slots", client, ring_elements);
+
+    // initialize the shared memory, there is no data waiting in the buffer
+    for (unsigned int i = 0; i < ring_elements; i++)
+    {
+        cl->ring[i].len = 0;
+    }
+
+    return OS_SUCCESS;
+}
+
 //------------------------------------------------------------------------------
 OS_Error_t
-chanmux_nic_driver_init(
+chanmux_nic_driver_ctx_init(
+    chanmux_nic_drv_t *ctx,
     const chanmux_nic_drv_config_t *driver_config)
 {
     Debug_LOG_INFO("network driver init");
 
-    // save configuration
-    config = driver_config;
+    if ((NULL == ctx) || (NULL == driver_config))
+    {
+        Debug_LOG_ERROR("context or configuration missing");
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    if (OS_Dataport_isUnset(driver_config->network_stack.to) ||
+        OS_Dataport_isUnset(driver_config->network_stack.from))
+    {
+        Debug_LOG_ERROR("network stack dataports not set");
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // save configuration, the context is set up from scratch
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->config = driver_config;
+    const chanmux_nic_drv_config_t *config = driver_config;
 
-    // initialize the shared memory, there is no data waiting in the buffer
-    const OS_SharedBuffer_t *nw_input = get_network_stack_port_to();
-    OS_NetworkStack_RxBuffer_t *nw_rx = (OS_NetworkStack_RxBuffer_t *)
-                                            nw_input->buffer;
-    nw_rx->len = 0;
+    ctx->network_stack_port_to.buffer = OS_Dataport_getBuf(config->network_stack.to);
+    ctx->network_stack_port_to.len = OS_Dataport_getSize(config->network_stack.to);
+    ctx->network_stack_port_from.buffer = OS_Dataport_getBuf(config->network_stack.from);
+    ctx->network_stack_port_from.len = OS_Dataport_getSize(config->network_stack.from);
+
+    // the network stack is client 0, further clients get frames by steering
+    OS_Error_t err = rx_client_init(ctx, 0, get_network_stack_port_to(ctx),
+                                    config->network_stack.notify,
+                                    config->network_stack.rx_slot_wait);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+    unsigned int clients = config->rx.steering.clients;
+    if (0 == clients)
+    {
+        clients = 1;
+    }
+    if (clients > CHANMUX_NIC_DRV_RX_CLIENTS_MAX)
+    {
+        Debug_LOG_WARNING("%u RX clients requested, using %u",
+                          clients, CHANMUX_NIC_DRV_RX_CLIENTS_MAX);
+        clients = CHANMUX_NIC_DRV_RX_CLIENTS_MAX;
+    }
+    for (unsigned int i = 1; i < clients; i++)
+    {
+        OS_Dataport_t to = config->rx.steering.client[i - 1].to;
+        if (OS_Dataport_isUnset(to))
+        {
+            Debug_LOG_ERROR("dataport of RX client %u not set", i);
+            return OS_ERROR_INVALID_PARAMETER;
+        }
+        const OS_SharedBuffer_t port = {
+            .buffer = OS_Dataport_getBuf(to),
+            .len = OS_Dataport_getSize(to)
+        };
+        err = rx_client_init(ctx, i, &port,
+                             config->rx.steering.client[i - 1].notify,
+                             config->rx.steering.client[i - 1].rx_slot_wait);
+        if (err != OS_SUCCESS)
+        {
+            return err;
+        }
+    }
+    ctx->rx.clients = clients;
+
+    if ((clients > 1) && config->rx.steering.hash)
+    {
+        chanmux_nic_rx_steer_init(ctx);
+    }
+
+    // polling starts with the full budget, it adapts to the load then
+    ctx->rx.poll_budget = config->rx.poll_budget;
+
+    // a merged frame is bigger than a slot
+    ctx->rx.lro.max_len = config->rx.lro.max_len;
+    if ((0 != ctx->rx.lro.max_len) && !config->rx.chain_slots)
+    {
+        Debug_LOG_WARNING("LRO needs chained RX slots, disabled");
+        ctx->rx.lro.max_len = 0;
+    }
+    if ((0 != ctx->rx.lro.max_len) && (0 != config->rx.lro.timeout_ns) &&
+        !config->clock.get_time_ns)
+    {
+        Debug_LOG_WARNING("LRO timeout needs a clock, merged frames are "
+                          "handed over only before the driver waits for data");
+    }
+
+    // the counters live in the stats dataport if there is one that is big
+    // enough, otherwise in the context.
+    ctx->stats = &ctx->stats_buffer;
+    if (!OS_Dataport_isUnset(config->stats.port))
+    {
+        if (OS_Dataport_getSize(config->stats.port) < sizeof(chanmux_nic_drv_stats_t))
+        {
+            Debug_LOG_ERROR("stats dataport of %zu bytes too small, need %zu",
+                            OS_Dataport_getSize(config->stats.port),
+                            sizeof(chanmux_nic_drv_stats_t));
+            return OS_ERROR_INVALID_PARAMETER;
+        }
+        ctx->stats = OS_Dataport_getBuf(config->stats.port);
+    }
+    memset(ctx->stats, 0, sizeof(*ctx->stats));
+
+    ctx->latency.enabled = config->stats.latency && config->clock.get_time_ns;
+    if (config->stats.latency && !ctx->latency.enabled)
+    {
+        Debug_LOG_WARNING("latency tracing needs a clock, disabled");
+    }
 
     // initialize the ChanMUX/Proxy connection
-    const ChanMux_ChannelOpsCtx_t *ctrl = get_chanmux_channel_ctrl();
-    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data();
+    const ChanMux_ChannelOpsCtx_t *ctrl = get_chanmux_channel_ctrl(ctx);
+    const ChanMux_ChannelOpsCtx_t *data = get_chanmux_channel_data(ctx);
 
     Debug_LOG_INFO("ChanMUX channels: ctrl=%u, data=%u", ctrl->id, data->id);
 
-    OS_Error_t err = chanmux_nic_channel_open(ctrl, data->id);
+    // a peer that does not answer at all would still block the caller
+    if ((0 != config->ctrl.timeout_ns) &&
+        (!config->ctrl.wait_timeout || !config->clock.get_time_ns))
+    {
+        Debug_LOG_ERROR("ctrl.timeout_ns needs ctrl.wait_timeout and a clock");
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // a caller waiting on the semaphore would never be woken up
+    if (!config->ctrl.rsp_wait != !config->ctrl.rsp_notify)
+    {
+        Debug_LOG_ERROR("ctrl.rsp_wait and ctrl.rsp_notify must be set both");
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Parsing frames in the read dataport is only safe if a TX operation can't
+    // overwrite it while the RX loop still has unprocessed data there.
+    ctx->rx.zero_copy = config->rx.zero_copy;
+    if (ctx->rx.zero_copy && (OS_Dataport_getBuf(data->port.read) ==
+                              OS_Dataport_getBuf(data->port.write)))
+    {
+        Debug_LOG_WARNING("ChanMUX data channel uses one dataport for read "
+                          "and write, RX zero-copy mode disabled");
+        ctx->rx.zero_copy = false;
+    }
+    Debug_LOG_INFO("RX zero-copy mode %s",
+                   ctx->rx.zero_copy ? "enabled" : "disabled");
+
+    // TX frames can be sent in place only if the network stack writes them
+    // directly into the ChanMUX write port. The RX loop would overwrite them
+    // there if it is also the read port.
+    const OS_SharedBuffer_t *nw_output = get_network_stack_port_from(ctx);
+    if ((nw_output->buffer == OS_Dataport_getBuf(data->port.write)) &&
+        (OS_Dataport_getBuf(data->port.read) ==
+         OS_Dataport_getBuf(data->port.write)))
+    {
+        Debug_LOG_ERROR("network stack output is the ChanMUX write port, "
+                        "which is also the read port");
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    ctx->tx.zero_copy = config->tx.zero_copy &&
+                        (nw_output->buffer == OS_Dataport_getBuf(data->port.write));
+    if (config->tx.zero_copy && !ctx->tx.zero_copy)
+    {
+        Debug_LOG_WARNING("network stack output is not the ChanMUX write "
+                          "port, TX zero-copy mode disabled");
+    }
+    if (ctx->tx.zero_copy && (config->tx.aggregate_max_frames > 1))
+    {
+        Debug_LOG_WARNING("TX aggregation not possible in TX zero-copy mode");
+    }
+    Debug_LOG_INFO("TX zero-copy mode %s",
+                   ctx->tx.zero_copy ? "enabled" : "disabled");
+
+    // the queue replaces the ChanMUX write port as the place where frames wait
+    if ((NULL != config->tx.queue.buffer) && (0 != config->tx.queue.size))
+    {
+        size_t high_watermark = config->tx.queue.high_watermark;
+        if (0 == high_watermark)
+        {
+            high_watermark = config->tx.queue.size;
+        }
+        size_t low_watermark = config->tx.queue.low_watermark;
+        if (0 == low_watermark)
+        {
+            low_watermark = high_watermark / 2;
+        }
+        if ((high_watermark > config->tx.queue.size) ||
+            (low_watermark >= high_watermark))
+        {
+            Debug_LOG_ERROR("TX queue of %zu bytes with invalid watermarks "
+                            "%zu/%zu", config->tx.queue.size, high_watermark,
+                            low_watermark);
+            return OS_ERROR_INVALID_PARAMETER;
+        }
+
+        if (ctx->tx.zero_copy)
+        {
+            Debug_LOG_WARNING("TX queue not possible in TX zero-copy mode");
+        }
+        else
+        {
+            // each priority class gets an equal part of the queue
+            unsigned int classes = config->tx.queue.classes;
+            if (0 == classes)
+            {
+                classes = 1;
+            }
+            if (classes > CHANMUX_NIC_DRV_TX_CLASSES_MAX)
+            {
+                Debug_LOG_WARNING("%u TX classes requested, using %u",
+                                  classes, CHANMUX_NIC_DRV_TX_CLASSES_MAX);
+                classes = CHANMUX_NIC_DRV_TX_CLASSES_MAX;
+            }
+            if (high_watermark / classes < 2 + ETHERNET_FRAME_MAX_SIZE)
+            {
+                Debug_LOG_ERROR("TX queue high watermark %zu too low for %u "
+                                "classes, each needs %d bytes", high_watermark,
+                                classes, 2 + ETHERNET_FRAME_MAX_SIZE);
+                return OS_ERROR_INVALID_PARAMETER;
+            }
+            size_t class_size = config->tx.queue.size / classes;
+            for (unsigned int i = 0; i < classes; i++)
+            {
+                chanmux_nic_drv_tx_queue_t *q = &ctx->tx.queue.q[i];
+                q->buffer = (uint8_t *)config->tx.queue.buffer + i * class_size;
+                q->size = class_size;
+                q->high_watermark = high_watermark / classes;
+                q->low_watermark = low_watermark / classes;
+                q->quantum = config->tx.queue.quantum[i];
+                if (0 == q->quantum)
+                {
+                    q->quantum = 2 + ETHERNET_FRAME_MAX_SIZE;
+                }
+            }
+            ctx->tx.queue.classes = classes;
+            ctx->tx.queue.sched.rr = 1;
+            ctx->tx.queue.sched.deficit[1] = ctx->tx.queue.q[1].quantum;
+            Debug_LOG_INFO("TX queue has %u classes of %zu bytes, watermarks "
+                           "%zu/%zu", classes, class_size,
+                           high_watermark / classes, low_watermark / classes);
+        }
+    }
+
+    // Without a TX queue, aggregated frames wait in the write port, where RX
+    // would overwrite them if the port is also the read port.
+    if ((get_tx_aggregate_max_frames(ctx) > 1) && !is_tx_queue_enabled(ctx) &&
+        (OS_Dataport_getBuf(data->port.read) ==
+         OS_Dataport_getBuf(data->port.write)))
+    {
+        Debug_LOG_WARNING("ChanMUX data channel uses one dataport for read "
+                          "and write, TX aggregation disabled");
+        ctx->tx.aggr.disabled = true;
+    }
+
+    if ((get_tx_aggregate_max_frames(ctx) > 1) &&
+        ((0 == config->tx.aggregate_deadline_ns) || !config->clock.get_time_ns))
+    {
+        Debug_LOG_WARNING("TX aggregation without flush deadline, network "
+                          "stack must call chanmux_nic_driver_rpc_tx_flush()");
+    }
+
+    err = chanmux_nic_channel_open(ctx);
     if (err != OS_SUCCESS)
     {
         Debug_LOG_ERROR("chanmux_nic_channel_open() failed, error:%d", err);
-        return OS_ERROR_GENERIC;
+        return (OS_ERROR_TIMEOUT == err) ? err : OS_ERROR_GENERIC;
+    }
+
+    // the filter needs the MAC, all multicast passes until the network stack
+    // sets up the hash table
+    ctx->rx.filter.enabled = config->rx.filter;
+    ctx->rx.filter.flags = CHANMUX_NIC_DRV_RX_FILTER_ALL_MULTI;
+    if (config->rx.filter && !get_caps(ctx)->mac_valid)
+    {
+        Debug_LOG_WARNING("MAC unknown, RX filter passes all unicast");
     }
 
     Debug_LOG_INFO("network driver init successful");
@@ -188,11 +734,12 @@ chanmux_nic_driver_init(
 
 //------------------------------------------------------------------------------
 OS_Error_t
-chanmux_nic_driver_run(void)
+chanmux_nic_driver_ctx_run(
+    chanmux_nic_drv_t *ctx)
 {
     Debug_LOG_INFO("start network driver loop");
     // this loop is not supposed to terminate
-    OS_Error_t err = chanmux_nic_driver_loop();
+    OS_Error_t err = chanmux_nic_driver_loop(ctx);
     if (err != OS_SUCCESS)
     {
         Debug_LOG_ERROR("chanmux_receive_loop() failed, error %d", err);
@@ -205,3 +752,25 @@ chanmux_nic_driver_run(void)
 
     return OS_SUCCESS;
 }
+
+//------------------------------------------------------------------------------
+chanmux_nic_drv_t *
+get_default_ctx(void)
+{
+    return &default_ctx;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_init(
+    const chanmux_nic_drv_config_t *driver_config)
+{
+    return chanmux_nic_driver_ctx_init(&default_ctx, driver_config);
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+chanmux_nic_driver_run(void)
+{
+    return chanmux_nic_driver_ctx_run(&default_ctx);
+}
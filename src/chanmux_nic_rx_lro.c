@@ -0,0 +1,174 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX large receive offload
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "chanmux_nic_rx_lro.h"
+#include "chanmux_nic_drv.h"
+#include "chanmux_nic_csum.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define IPV4_HDR_LEN    20
+
+//------------------------------------------------------------------------------
+// Sum of the pseudo header, the addresses, zero, protocol and the TCP length.
+static uint64_t
+lro_pseudo_sum(
+    const uint8_t *hdr,
+    size_t ip,
+    size_t tcp_len)
+{
+    uint8_t pseudo[4] = { 0, IP_PROTO_TCP, (tcp_len >> 8) & 0xFF, tcp_len & 0xFF };
+    uint64_t sum = chanmux_nic_csum_partial(&hdr[ip + 12], 8, 0);
+    return chanmux_nic_csum_partial(pseudo, sizeof(pseudo), sum);
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_rx_lro_get_seg(
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len,
+    chanmux_nic_drv_rx_lro_seg_t *seg)
+{
+    size_t ip = ETH_HDR_LEN;
+    if (hdr_len < ip + IPV4_HDR_LEN)
+    {
+        return false;
+    }
+    uint16_t ethertype = get_be16(&hdr[ip - 2]);
+    if (ETHERTYPE_VLAN == ethertype)
+    {
+        ip += ETH_VLAN_TAG_LEN;
+        if (hdr_len < ip + IPV4_HDR_LEN)
+        {
+            return false;
+        }
+        ethertype = get_be16(&hdr[ip - 2]);
+    }
+
+    // version 4 and no options, no fragment
+    if ((ETHERTYPE_IPV4 != ethertype) || (0x45 != hdr[ip]) ||
+        (IP_PROTO_TCP != hdr[ip + 9]) ||
+        (0 != (get_be16(&hdr[ip + 6]) & 0x3FFF)))
+    {
+        return false;
+    }
+
+    const size_t tcp = ip + IPV4_HDR_LEN;
+    if (hdr_len < tcp + 20)
+    {
+        return false;
+    }
+    const size_t ip_len = get_be16(&hdr[ip + 2]);
+    const size_t tcp_hdr_len = (hdr[tcp + 12] >> 4) * 4;
+    const uint8_t flags = hdr[tcp + 13];
+
+    // Ethernet padding would end up in the merged data, so a frame must end
+    // with the IP packet
+    if ((tcp_hdr_len < 20) || (hdr_len < tcp + tcp_hdr_len) ||
+        (ip + ip_len != frame_len) ||
+        (IPV4_HDR_LEN + tcp_hdr_len >= ip_len) ||
+        (TCP_FLAG_ACK != (flags & ~TCP_FLAG_PSH)))
+    {
+        return false;
+    }
+
+    // the header checksum is checked here, a merged frame gets a new one
+    if (0xFFFF != chanmux_nic_csum_fold(
+            chanmux_nic_csum_partial(&hdr[ip], IPV4_HDR_LEN, 0)))
+    {
+        return false;
+    }
+
+    seg->ip = ip;
+    seg->hdr_len = tcp + tcp_hdr_len;
+    seg->payload_len = ip_len - IPV4_HDR_LEN - tcp_hdr_len;
+    seg->seq = get_be32(&hdr[tcp + 4]);
+    seg->flags = flags;
+    seg->hdr_sum = chanmux_nic_csum_partial(hdr, seg->hdr_len, 0);
+    seg->tcp_sum = chanmux_nic_csum_partial(&hdr[tcp], tcp_hdr_len,
+                                            lro_pseudo_sum(hdr, ip,
+                                                           ip_len - IPV4_HDR_LEN));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_rx_lro_is_same_flow(
+    const uint8_t *held,
+    size_t held_hdr_len,
+    const uint8_t *hdr,
+    const chanmux_nic_drv_rx_lro_seg_t *seg)
+{
+    const size_t ip = seg->ip;
+    const size_t tcp = ip + IPV4_HDR_LEN;
+
+    // All fields but the IP length, ID and header checksum and the TCP
+    // sequence number, flags and checksum must match. This covers the MACs,
+    // the VLAN tag, the addresses and ports, the ACK, the window and the
+    // TCP options.
+    return (held_hdr_len == seg->hdr_len) &&
+           (0 == memcmp(held, hdr, ip + 2)) &&
+           (0 == memcmp(&held[ip + 6], &hdr[ip + 6], 4)) &&
+           (0 == memcmp(&held[ip + 12], &hdr[ip + 12], 12)) &&
+           (0 == memcmp(&held[tcp + 8], &hdr[tcp + 8], 5)) &&
+           (0 == memcmp(&held[tcp + 14], &hdr[tcp + 14], 2)) &&
+           (0 == memcmp(&held[tcp + 18], &hdr[tcp + 18], seg->hdr_len - tcp - 18));
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_rx_lro_check_seg(
+    const chanmux_nic_drv_rx_lro_seg_t *seg,
+    uint64_t sum,
+    uint64_t *payload_sum)
+{
+    // one's complement subtraction is adding the inverted value. The header
+    // length is even, so the payload sum needs no byte swap.
+    *payload_sum = chanmux_nic_csum_add(sum,
+                                        (uint16_t)~chanmux_nic_csum_fold(seg->hdr_sum),
+                                        false);
+    return (0xFFFF == chanmux_nic_csum_fold(
+                chanmux_nic_csum_add(*payload_sum, seg->tcp_sum, false)));
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_lro_finish(
+    uint8_t *hdr,
+    size_t ip,
+    size_t hdr_len,
+    size_t frame_len,
+    uint64_t payload_sum,
+    bool push)
+{
+    const size_t tcp = ip + IPV4_HDR_LEN;
+    const size_t ip_len = frame_len - ip;
+    const uint16_t zero = 0;
+
+    hdr[ip + 2] = (ip_len >> 8) & 0xFF;
+    hdr[ip + 3] = ip_len & 0xFF;
+    memcpy(&hdr[ip + 10], &zero, sizeof(zero));
+    uint16_t csum = ~chanmux_nic_csum_fold(
+                        chanmux_nic_csum_partial(&hdr[ip], IPV4_HDR_LEN, 0));
+    memcpy(&hdr[ip + 10], &csum, sizeof(csum));
+
+    if (push)
+    {
+        hdr[tcp + 13] |= TCP_FLAG_PSH;
+    }
+    memcpy(&hdr[tcp + 16], &zero, sizeof(zero));
+    uint64_t sum = lro_pseudo_sum(hdr, ip, ip_len - IPV4_HDR_LEN);
+    sum = chanmux_nic_csum_partial(&hdr[tcp], hdr_len - tcp, sum);
+    csum = ~chanmux_nic_csum_fold(chanmux_nic_csum_add(sum, payload_sum, false));
+    memcpy(&hdr[tcp + 16], &csum, sizeof(csum));
+}
@@ -0,0 +1,94 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX large receive offload
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include "chanmux_nic_drv_api.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes at the start of a frame LRO looks at. This covers the Ethernet header
+// with a VLAN tag, an IPv4 header without options and the largest TCP header.
+#define CHANMUX_NIC_RX_LRO_HDR_LEN      (14 + 4 + 20 + 60)
+
+/**
+ * @details check if a frame is a TCP segment that can be merged with others.
+ *  It must be IPv4 without options and fragments, carry data without Ethernet
+ *  padding and have no TCP flags but ACK and PSH. The IPv4 header checksum
+ *  is checked also.
+ *
+ * @param hdr start of the frame
+ * @param hdr_len bytes at hdr, CHANMUX_NIC_RX_LRO_HDR_LEN or the frame length
+ *  if it is shorter
+ * @param frame_len length of the frame
+ * @param seg receives the segment
+ *
+ * @retval true if the frame can be merged
+ */
+bool
+chanmux_nic_rx_lro_get_seg(
+    const uint8_t *hdr,
+    size_t hdr_len,
+    size_t frame_len,
+    chanmux_nic_drv_rx_lro_seg_t *seg);
+
+/**
+ * @details check if a segment belongs to the same flow as a held frame and
+ *  has the same headers, apart from the fields merging changes anyway
+ *
+ * @param held headers of the held frame
+ * @param held_hdr_len header length of the held frame
+ * @param hdr headers of the segment
+ * @param seg the segment
+ *
+ * @retval true if the segment can be merged into the held frame
+ */
+bool
+chanmux_nic_rx_lro_is_same_flow(
+    const uint8_t *held,
+    size_t held_hdr_len,
+    const uint8_t *hdr,
+    const chanmux_nic_drv_rx_lro_seg_t *seg);
+
+/**
+ * @details check the TCP checksum of a segment and get the sum of its payload
+ *
+ * @param seg the segment
+ * @param sum partial checksum sum of the whole frame
+ * @param payload_sum receives the partial sum of the TCP payload
+ *
+ * @retval true if the TCP checksum is correct
+ */
+bool
+chanmux_nic_rx_lro_check_seg(
+    const chanmux_nic_drv_rx_lro_seg_t *seg,
+    uint64_t sum,
+    uint64_t *payload_sum);
+
+/**
+ * @details update the headers of a merged frame, the IP length, the IPv4
+ *  header checksum and the TCP checksum
+ *
+ * @param hdr headers of the merged frame, from the first segment
+ * @param ip IPv4 header offset
+ * @param hdr_len Ethernet, IPv4 and TCP header length
+ * @param frame_len length of the merged frame
+ * @param payload_sum partial sum of the merged TCP payload
+ * @param push set the PSH flag
+ */
+void
+chanmux_nic_rx_lro_finish(
+    uint8_t *hdr,
+    size_t ip,
+    size_t hdr_len,
+    size_t frame_len,
+    uint64_t payload_sum,
+    bool push);
@@ -0,0 +1,566 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX frame parser
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "lib_debug/Debug.h"
+#include "chanmux_nic_rx_parser.h"
+#include "chanmux_nic_crc32.h"
+#include "chanmux_nic_csum.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_init(
+    chanmux_nic_rx_parser_t *parser,
+    size_t max_frame_len,
+    chanmux_nic_rx_parser_framing_t framing)
+{
+    parser->max_frame_len = max_frame_len;
+    parser->buf_size = max_frame_len;
+    parser->peek_len = 0;
+    parser->csum = false;
+    parser->framing = framing;
+    parser->seq_valid = false;
+    parser->seq_next = 0;
+    parser->lost_frames = 0;
+    chanmux_nic_rx_parser_reset(parser);
+    // the stream starts with a frame, anything else is reported
+    parser->in_sync = true;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_reset(
+    chanmux_nic_rx_parser_t *parser)
+{
+    parser->state = (CHANMUX_NIC_RX_PARSER_FRAMING_V2 == parser->framing)
+                    ? CHANMUX_NIC_RX_PARSER_STATE_V2_HEADER
+                    : CHANMUX_NIC_RX_PARSER_STATE_LEN;
+    parser->len_bytes = 0;
+    parser->frame_len = 0;
+    parser->frame_offset = 0;
+    parser->frame_buf = NULL;
+    parser->buf_offset = 0;
+    parser->peek_bytes = 0;
+    parser->hdr_bytes = 0;
+    parser->in_sync = false;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_set_buffer_size(
+    chanmux_nic_rx_parser_t *parser,
+    size_t buf_size)
+{
+    Debug_ASSERT(buf_size > 0);
+
+    parser->buf_size = buf_size;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_set_peek_len(
+    chanmux_nic_rx_parser_t *parser,
+    size_t peek_len)
+{
+    Debug_ASSERT(peek_len <= CHANMUX_NIC_RX_PARSER_PEEK_MAX);
+    Debug_ASSERT(peek_len <= parser->buf_size);
+
+    parser->peek_len = peek_len;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_set_csum(
+    chanmux_nic_rx_parser_t *parser,
+    bool enable)
+{
+    parser->csum = enable;
+}
+
+//------------------------------------------------------------------------------
+// Copy frame data at the current frame offset, taking the checksum sum in the
+// same pass if enabled.
+static void
+frame_copy(
+    chanmux_nic_rx_parser_t *parser,
+    uint8_t *dst,
+    const uint8_t *src,
+    size_t len)
+{
+    if (!parser->csum)
+    {
+        memcpy(dst, src, len);
+    }
+    else if (0 == (parser->frame_offset & 1))
+    {
+        parser->csum_sum = chanmux_nic_csum_copy(dst, src, len, parser->csum_sum);
+    }
+    else
+    {
+        parser->csum_sum = chanmux_nic_csum_add(parser->csum_sum,
+                                                chanmux_nic_csum_copy(dst, src,
+                                                                      len, 0),
+                                                true);
+    }
+}
+
+//------------------------------------------------------------------------------
+// The frame length is known, set up receiving the frame data. Returns true if
+// a buffer is needed now.
+static bool
+frame_start(
+    chanmux_nic_rx_parser_t *parser)
+{
+    parser->frame_offset = 0;
+    parser->frame_buf = NULL;
+    parser->buf_offset = 0;
+    parser->peek_bytes = 0;
+    parser->skipped = false;
+    parser->csum_sum = 0;
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_DATA;
+
+    // if the frame is too big for the buffer, then the only option is
+    // dropping it. Empty frames are dropped also, there is nothing we could
+    // hand over.
+    if ((0 == parser->frame_len) || (parser->frame_len > parser->max_frame_len))
+    {
+        return false;
+    }
+
+    if (parser->peek_len > 0)
+    {
+        parser->state = CHANMUX_NIC_RX_PARSER_STATE_PEEK;
+        return false;
+    }
+
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_BUFFER;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// check the v2 header bytes received so far
+static bool
+v2_hdr_is_valid(
+    const chanmux_nic_rx_parser_t *parser)
+{
+    const uint8_t *hdr = parser->hdr;
+
+    if ((parser->hdr_bytes >= 1) && (CHANMUX_NIC_RX_PARSER_V2_SYNC_0 != hdr[0]))
+    {
+        return false;
+    }
+    if ((parser->hdr_bytes >= 2) && (CHANMUX_NIC_RX_PARSER_V2_SYNC_1 != hdr[1]))
+    {
+        return false;
+    }
+    if (parser->hdr_bytes >= CHANMUX_NIC_RX_PARSER_V2_HDR_LEN)
+    {
+        uint16_t len = (hdr[4] << 8) | hdr[5];
+        uint16_t len_inv = (hdr[6] << 8) | hdr[7];
+        if (0xFFFF != (len ^ len_inv))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// The header is invalid, but the next frame may start within the bytes we have
+// already. Drop bytes from the front until they could be the start of a
+// header again.
+static void
+v2_hdr_resync(
+    chanmux_nic_rx_parser_t *parser)
+{
+    do
+    {
+        parser->hdr_bytes--;
+        memmove(parser->hdr, &parser->hdr[1], parser->hdr_bytes);
+    } while ((parser->hdr_bytes > 0) && !v2_hdr_is_valid(parser));
+}
+
+//------------------------------------------------------------------------------
+// A complete v2 header was received, set up the frame.
+static chanmux_nic_rx_parser_event_t
+v2_hdr_complete(
+    chanmux_nic_rx_parser_t *parser)
+{
+    parser->frame_seq = (parser->hdr[2] << 8) | parser->hdr[3];
+    parser->frame_len = (parser->hdr[4] << 8) | parser->hdr[5];
+    parser->hdr_bytes = 0;
+    parser->in_sync = true;
+    parser->crc = CHANMUX_NIC_CRC32_INIT;
+
+    return frame_start(parser) ? CHANMUX_NIC_RX_PARSER_NEED_BUFFER
+           : CHANMUX_NIC_RX_PARSER_NEED_DATA;
+}
+
+//------------------------------------------------------------------------------
+// The CRC trailer was received. Only a frame with a matching CRC has a
+// sequence number that can be trusted.
+static chanmux_nic_rx_parser_event_t
+v2_crc_complete(
+    chanmux_nic_rx_parser_t *parser)
+{
+    const uint8_t *trailer = parser->hdr;
+    uint32_t crc = ((uint32_t)trailer[0] << 24) | ((uint32_t)trailer[1] << 16) |
+                   ((uint32_t)trailer[2] << 8) | trailer[3];
+
+    bool isDropped = (NULL == parser->frame_buf);
+    parser->frame_buf = NULL;
+    parser->hdr_bytes = 0;
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_V2_HEADER;
+
+    if (crc != chanmux_nic_crc32_final(parser->crc))
+    {
+        return CHANMUX_NIC_RX_PARSER_FRAME_CORRUPT;
+    }
+
+    // a gap in the sequence numbers is what we have lost since the last good
+    // frame, corrupted frames included.
+    if (parser->seq_valid)
+    {
+        parser->lost_frames += (uint16_t)(parser->frame_seq - parser->seq_next);
+    }
+    parser->seq_valid = true;
+    parser->seq_next = parser->frame_seq + 1;
+
+    if (parser->skipped)
+    {
+        return CHANMUX_NIC_RX_PARSER_FRAME_SKIPPED;
+    }
+    return isDropped ? CHANMUX_NIC_RX_PARSER_FRAME_DROPPED
+           : CHANMUX_NIC_RX_PARSER_FRAME;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_set_buffer(
+    chanmux_nic_rx_parser_t *parser,
+    uint8_t *buf)
+{
+    Debug_ASSERT(CHANMUX_NIC_RX_PARSER_STATE_BUFFER == parser->state);
+    Debug_ASSERT(NULL != buf);
+
+    parser->frame_buf = buf;
+    parser->buf_offset = 0;
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_DATA;
+
+    // the bytes collected already go first
+    if (parser->peek_bytes > 0)
+    {
+        memcpy(buf, parser->peek, parser->peek_bytes);
+        parser->buf_offset = parser->peek_bytes;
+        parser->peek_bytes = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_append_buffer(
+    chanmux_nic_rx_parser_t *parser,
+    uint8_t *buf,
+    size_t buf_len,
+    size_t skip)
+{
+    Debug_ASSERT(CHANMUX_NIC_RX_PARSER_STATE_BUFFER == parser->state);
+    Debug_ASSERT(NULL != buf);
+    Debug_ASSERT(skip <= parser->peek_bytes);
+    Debug_ASSERT(buf_len + parser->peek_bytes - skip <= parser->buf_size);
+
+    parser->frame_buf = buf;
+    parser->buf_offset = buf_len;
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_DATA;
+
+    if (parser->peek_bytes > skip)
+    {
+        memcpy(&buf[buf_len], &parser->peek[skip], parser->peek_bytes - skip);
+        parser->buf_offset += parser->peek_bytes - skip;
+    }
+    parser->peek_bytes = 0;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_parser_skip_frame(
+    chanmux_nic_rx_parser_t *parser)
+{
+    Debug_ASSERT(CHANMUX_NIC_RX_PARSER_STATE_BUFFER == parser->state);
+    Debug_ASSERT(0 == parser->buf_offset);
+
+    // consumed like a frame that does not fit, the v2 CRC is still checked
+    // to keep track of the sequence numbers
+    parser->frame_buf = NULL;
+    parser->peek_bytes = 0;
+    parser->skipped = true;
+    parser->state = CHANMUX_NIC_RX_PARSER_STATE_DATA;
+}
+
+//------------------------------------------------------------------------------
+// This function implements a FSM that has a big switch-case construct. Those
+// kind of functions, when decomposed, often result in a less readable code.
+// Therefore we suppress the cyclomatic complexity analysis for this function.
+// metrix++: suppress std.code.complexity:cyclomatic
+chanmux_nic_rx_parser_event_t
+chanmux_nic_rx_parser_feed(
+    chanmux_nic_rx_parser_t *parser,
+    const uint8_t *data,
+    size_t len,
+    size_t *consumed)
+{
+    size_t offset = 0;
+
+    for (;;)
+    {
+        switch (parser->state)
+        {
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_LEN:
+            // frame length is send in network byte order (big endian). Usually
+            // both bytes are there and we take them in one step. Only if a
+            // chunk ends within the length we have to collect it byte by byte.
+            if ((0 == parser->len_bytes) && (len - offset >= 2))
+            {
+                parser->frame_len = ((size_t)data[offset] << 8) | data[offset + 1];
+                offset += 2;
+            }
+            else
+            {
+                if (offset == len)
+                {
+                    *consumed = offset;
+                    return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+                }
+
+                if (0 == parser->len_bytes)
+                {
+                    parser->frame_len = 0;
+                }
+                parser->frame_len = (parser->frame_len << 8) | data[offset++];
+                if (++parser->len_bytes < 2)
+                {
+                    break;
+                }
+                parser->len_bytes = 0;
+            }
+
+            if (frame_start(parser))
+            {
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_BUFFER;
+            }
+            break;
+
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_BUFFER:
+            *consumed = offset;
+            return CHANMUX_NIC_RX_PARSER_NEED_BUFFER;
+
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_PEEK:
+        {
+            size_t peek_len = parser->peek_len;
+            if (peek_len > parser->frame_len)
+            {
+                peek_len = parser->frame_len;
+            }
+            size_t chunk_len = peek_len - parser->peek_bytes;
+            if (chunk_len > len - offset)
+            {
+                chunk_len = len - offset;
+            }
+            frame_copy(parser, &parser->peek[parser->peek_bytes], &data[offset],
+                       chunk_len);
+            if (CHANMUX_NIC_RX_PARSER_FRAMING_V2 == parser->framing)
+            {
+                parser->crc = chanmux_nic_crc32_update(parser->crc,
+                                                       &data[offset],
+                                                       chunk_len);
+            }
+            offset += chunk_len;
+            parser->peek_bytes += chunk_len;
+            parser->frame_offset += chunk_len;
+
+            if (parser->peek_bytes < peek_len)
+            {
+                Debug_ASSERT(offset == len);
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+            }
+
+            parser->state = CHANMUX_NIC_RX_PARSER_STATE_BUFFER;
+            *consumed = offset;
+            return CHANMUX_NIC_RX_PARSER_NEED_BUFFER;
+        }
+
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_DATA:
+        {
+            size_t chunk_len = parser->frame_len - parser->frame_offset;
+            if (chunk_len > len - offset)
+            {
+                chunk_len = len - offset;
+            }
+
+            if (NULL != parser->frame_buf)
+            {
+                // a frame bigger than the buffer continues in the next one
+                if (chunk_len > parser->buf_size - parser->buf_offset)
+                {
+                    chunk_len = parser->buf_size - parser->buf_offset;
+                }
+                frame_copy(parser,
+                           &parser->frame_buf[parser->buf_offset],
+                           &data[offset],
+                           chunk_len);
+                parser->buf_offset += chunk_len;
+            }
+            if (CHANMUX_NIC_RX_PARSER_FRAMING_V2 == parser->framing)
+            {
+                parser->crc = chanmux_nic_crc32_update(parser->crc,
+                                                       &data[offset],
+                                                       chunk_len);
+            }
+            offset += chunk_len;
+            parser->frame_offset += chunk_len;
+
+            if (parser->frame_offset < parser->frame_len)
+            {
+                if ((NULL != parser->frame_buf) &&
+                    (parser->buf_offset == parser->buf_size))
+                {
+                    parser->state = CHANMUX_NIC_RX_PARSER_STATE_BUFFER;
+                    *consumed = offset;
+                    return CHANMUX_NIC_RX_PARSER_NEED_BUFFER;
+                }
+
+                Debug_ASSERT(offset == len);
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+            }
+
+            if (CHANMUX_NIC_RX_PARSER_FRAMING_V2 == parser->framing)
+            {
+                parser->hdr_bytes = 0;
+                parser->state = CHANMUX_NIC_RX_PARSER_STATE_V2_CRC;
+                break;
+            }
+
+            bool isDropped = (NULL == parser->frame_buf);
+            parser->frame_buf = NULL;
+            parser->state = CHANMUX_NIC_RX_PARSER_STATE_LEN;
+            *consumed = offset;
+            if (parser->skipped)
+            {
+                return CHANMUX_NIC_RX_PARSER_FRAME_SKIPPED;
+            }
+            return isDropped ? CHANMUX_NIC_RX_PARSER_FRAME_DROPPED
+                   : CHANMUX_NIC_RX_PARSER_FRAME;
+        }
+
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_V2_HEADER:
+        {
+            if (offset == len)
+            {
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+            }
+
+            // without sync, skip everything up to the next sync marker
+            if (!parser->in_sync && (0 == parser->hdr_bytes))
+            {
+                const uint8_t *sync = memchr(&data[offset],
+                                             CHANMUX_NIC_RX_PARSER_V2_SYNC_0,
+                                             len - offset);
+                if (NULL == sync)
+                {
+                    offset = len;
+                    break;
+                }
+                offset = sync - data;
+            }
+
+            size_t chunk_len = CHANMUX_NIC_RX_PARSER_V2_HDR_LEN - parser->hdr_bytes;
+            if (chunk_len > len - offset)
+            {
+                chunk_len = len - offset;
+            }
+            memcpy(&parser->hdr[parser->hdr_bytes], &data[offset], chunk_len);
+            parser->hdr_bytes += chunk_len;
+            offset += chunk_len;
+
+            if (!v2_hdr_is_valid(parser))
+            {
+                bool wasInSync = parser->in_sync;
+                parser->in_sync = false;
+                v2_hdr_resync(parser);
+                if (wasInSync)
+                {
+                    *consumed = offset;
+                    return CHANMUX_NIC_RX_PARSER_SYNC_LOST;
+                }
+                break;
+            }
+
+            if (parser->hdr_bytes < CHANMUX_NIC_RX_PARSER_V2_HDR_LEN)
+            {
+                break;
+            }
+
+            if (CHANMUX_NIC_RX_PARSER_NEED_BUFFER == v2_hdr_complete(parser))
+            {
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_BUFFER;
+            }
+            break;
+        }
+
+        //----------------------------------------------------------------------
+        case CHANMUX_NIC_RX_PARSER_STATE_V2_CRC:
+        {
+            if (offset == len)
+            {
+                *consumed = offset;
+                return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+            }
+
+            size_t chunk_len = CHANMUX_NIC_RX_PARSER_V2_CRC_LEN - parser->hdr_bytes;
+            if (chunk_len > len - offset)
+            {
+                chunk_len = len - offset;
+            }
+            memcpy(&parser->hdr[parser->hdr_bytes], &data[offset], chunk_len);
+            parser->hdr_bytes += chunk_len;
+            offset += chunk_len;
+
+            if (parser->hdr_bytes < CHANMUX_NIC_RX_PARSER_V2_CRC_LEN)
+            {
+                break;
+            }
+
+            *consumed = offset;
+            return v2_crc_complete(parser);
+        }
+
+        //----------------------------------------------------------------------
+        default:
+            Debug_LOG_ERROR("invalid parser state %d", parser->state);
+            chanmux_nic_rx_parser_reset(parser);
+            *consumed = offset;
+            return CHANMUX_NIC_RX_PARSER_NEED_DATA;
+        } // end switch (parser->state)
+    }
+}
@@ -0,0 +1,323 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX frame parser
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The data channel carries a stream of frames in the format:
+//   2 byte frame length (big endian) | frame data | 2 byte frame length | ...
+// With framing v2 each frame has a header with sync marker and sequence
+// number and a CRC-32 trailer, see CHANMUX_NIC_FEATURE_RX_FRAMING_V2. The
+// parser is fed with chunks of this stream as they arrive and copies the
+// frame data into a buffer the caller provides. It keeps all state in the
+// parser object, so several instances can be used independently.
+
+#define CHANMUX_NIC_RX_PARSER_V2_SYNC_0     0xC3
+#define CHANMUX_NIC_RX_PARSER_V2_SYNC_1     0x5A
+#define CHANMUX_NIC_RX_PARSER_V2_HDR_LEN    8
+#define CHANMUX_NIC_RX_PARSER_V2_CRC_LEN    4
+#define CHANMUX_NIC_RX_PARSER_PEEK_MAX      128
+
+typedef enum
+{
+    CHANMUX_NIC_RX_PARSER_FRAMING_V1 = 0, // 2 byte length prefix
+    CHANMUX_NIC_RX_PARSER_FRAMING_V2      // sync, sequence number and CRC
+} chanmux_nic_rx_parser_framing_t;
+
+typedef enum
+{
+    CHANMUX_NIC_RX_PARSER_NEED_DATA = 0, // all input consumed
+    CHANMUX_NIC_RX_PARSER_NEED_BUFFER,   // frame length known, buffer required
+    CHANMUX_NIC_RX_PARSER_FRAME,         // frame complete in the buffer
+    CHANMUX_NIC_RX_PARSER_FRAME_DROPPED, // frame skipped, it does not fit
+    CHANMUX_NIC_RX_PARSER_FRAME_SKIPPED, // frame skipped on caller request
+    CHANMUX_NIC_RX_PARSER_FRAME_CORRUPT, // v2 only, frame has a CRC mismatch
+    CHANMUX_NIC_RX_PARSER_SYNC_LOST      // v2 only, searching the next frame
+} chanmux_nic_rx_parser_event_t;
+
+typedef struct
+{
+    enum
+    {
+        CHANMUX_NIC_RX_PARSER_STATE_LEN = 0,
+        CHANMUX_NIC_RX_PARSER_STATE_BUFFER,
+        CHANMUX_NIC_RX_PARSER_STATE_PEEK,
+        CHANMUX_NIC_RX_PARSER_STATE_DATA,
+        CHANMUX_NIC_RX_PARSER_STATE_V2_HEADER,
+        CHANMUX_NIC_RX_PARSER_STATE_V2_CRC
+    } state;
+    chanmux_nic_rx_parser_framing_t framing;
+    size_t max_frame_len; // larger frames are dropped
+    size_t len_bytes;     // bytes of the length prefix received so far
+    size_t frame_len;
+    size_t frame_offset;
+    uint8_t *frame_buf;   // NULL if the frame is dropped
+    size_t buf_size;      // a frame continues in the next buffer when full
+    size_t buf_offset;    // bytes of the frame in the current buffer
+    size_t peek_len;      // bytes collected before a buffer is requested
+    size_t peek_bytes;    // bytes collected for the current frame
+    bool skipped;         // the caller does not want the current frame
+    bool csum;            // take the IP checksum sum of the frame data
+    uint64_t csum_sum;    // partial checksum sum of the frame data so far
+    uint8_t peek[CHANMUX_NIC_RX_PARSER_PEEK_MAX];
+
+    // framing v2 only
+    uint8_t hdr[CHANMUX_NIC_RX_PARSER_V2_HDR_LEN]; // header or CRC trailer
+    size_t hdr_bytes;     // bytes of the header or trailer received so far
+    uint32_t crc;         // CRC of the frame data so far
+    bool in_sync;         // false while searching a sync marker
+    uint16_t frame_seq;   // sequence number of the current frame
+    bool seq_valid;       // a frame was received, seq_next is valid
+    uint16_t seq_next;    // expected sequence number of the next frame
+    uint64_t lost_frames; // frames lost, not yet taken by the caller
+} chanmux_nic_rx_parser_t;
+
+/**
+ * @details initialize the parser, it expects a length prefix or a v2 header
+ *  next
+ *
+ * @param parser the parser
+ * @param max_frame_len frames bigger than this are dropped
+ * @param framing data format of the stream
+ */
+void
+chanmux_nic_rx_parser_init(
+    chanmux_nic_rx_parser_t *parser,
+    size_t max_frame_len,
+    chanmux_nic_rx_parser_framing_t framing);
+
+/**
+ * @details drop any partial frame, the next byte fed is a length prefix. With
+ *  framing v2 the parser searches the next sync marker and keeps the sequence
+ *  number, so frames lost in between are counted.
+ *
+ * @param parser the parser
+ */
+void
+chanmux_nic_rx_parser_reset(
+    chanmux_nic_rx_parser_t *parser);
+
+/**
+ * @details set the size of the frame buffers. Frames up to max_frame_len are
+ *  split over several buffers then, the default is one buffer per frame.
+ *
+ * @param parser the parser
+ * @param buf_size size of each buffer
+ */
+void
+chanmux_nic_rx_parser_set_buffer_size(
+    chanmux_nic_rx_parser_t *parser,
+    size_t buf_size);
+
+/**
+ * @details collect the first bytes of each frame before a buffer is
+ *  requested, so the caller can look at the headers to pick the buffer. The
+ *  bytes are copied into the buffer when it is set. The default is 0, then a
+ *  buffer is requested as soon as the frame length is known.
+ *
+ * @param parser the parser
+ * @param peek_len number of bytes, max CHANMUX_NIC_RX_PARSER_PEEK_MAX and not
+ *  more than the buffer size
+ */
+void
+chanmux_nic_rx_parser_set_peek_len(
+    chanmux_nic_rx_parser_t *parser,
+    size_t peek_len);
+
+/**
+ * @details take the partial sum for the IP checksums of each frame while it
+ *  is copied into the buffers, see chanmux_nic_rx_parser_get_csum(). The
+ *  default is off.
+ *
+ * @param parser the parser
+ * @param enable true to take the sum
+ */
+void
+chanmux_nic_rx_parser_set_csum(
+    chanmux_nic_rx_parser_t *parser,
+    bool enable);
+
+/**
+ * @details skip the current frame instead of setting a buffer. This is
+ *  possible when CHANMUX_NIC_RX_PARSER_NEED_BUFFER was returned for the first
+ *  buffer of a frame, usually after a look at the collected bytes. The rest
+ *  of the frame is consumed without copying it, then
+ *  CHANMUX_NIC_RX_PARSER_FRAME_SKIPPED is returned.
+ *
+ * @param parser the parser
+ */
+void
+chanmux_nic_rx_parser_skip_frame(
+    chanmux_nic_rx_parser_t *parser);
+
+/**
+ * @details parse a chunk of the data stream. Parsing stops when the input is
+ *  consumed or an event needs handling by the caller, the remaining input must
+ *  be fed again then.
+ *
+ * @param parser the parser
+ * @param data chunk of the data stream
+ * @param len length of the chunk
+ * @param consumed receives the number of bytes consumed from the chunk
+ *
+ * @retval CHANMUX_NIC_RX_PARSER_NEED_DATA the chunk was consumed completely
+ * @retval CHANMUX_NIC_RX_PARSER_NEED_BUFFER call
+ *  chanmux_nic_rx_parser_set_buffer() before feeding more data. This is also
+ *  returned when the buffer is full and the frame continues in the next one.
+ * @retval CHANMUX_NIC_RX_PARSER_FRAME a frame is complete in the buffer
+ * @retval CHANMUX_NIC_RX_PARSER_FRAME_DROPPED a frame was skipped, because it
+ *  is empty or bigger than the max frame length
+ * @retval CHANMUX_NIC_RX_PARSER_FRAME_CORRUPT a frame was received, but its
+ *  CRC does not match. The buffer content must not be used.
+ * @retval CHANMUX_NIC_RX_PARSER_SYNC_LOST an invalid header was found, the
+ *  parser skips data until the next sync marker
+ */
+chanmux_nic_rx_parser_event_t
+chanmux_nic_rx_parser_feed(
+    chanmux_nic_rx_parser_t *parser,
+    const uint8_t *data,
+    size_t len,
+    size_t *consumed);
+
+/**
+ * @details set the buffer for the current frame after
+ *  CHANMUX_NIC_RX_PARSER_NEED_BUFFER was returned
+ *
+ * @param parser the parser
+ * @param buf buffer with the size set by
+ *  chanmux_nic_rx_parser_set_buffer_size(), default is max_frame_len bytes
+ */
+void
+chanmux_nic_rx_parser_set_buffer(
+    chanmux_nic_rx_parser_t *parser,
+    uint8_t *buf);
+
+/**
+ * @details set a buffer that already holds data for the current frame after
+ *  CHANMUX_NIC_RX_PARSER_NEED_BUFFER was returned for its first buffer. The
+ *  frame goes behind the data, without its first bytes. This appends the
+ *  payload of a frame to an earlier one.
+ *
+ * @param parser the parser
+ * @param buf buffer like for chanmux_nic_rx_parser_set_buffer()
+ * @param buf_len bytes in the buffer already
+ * @param skip frame bytes to drop, not more than the collected bytes. The
+ *  remaining collected bytes must fit into the buffer.
+ */
+void
+chanmux_nic_rx_parser_append_buffer(
+    chanmux_nic_rx_parser_t *parser,
+    uint8_t *buf,
+    size_t buf_len,
+    size_t skip);
+
+/**
+ * @details get the length of the current frame, it is valid once the length
+ *  prefix was parsed
+ *
+ * @param parser the parser
+ *
+ * @retval frame length
+ */
+static inline size_t
+chanmux_nic_rx_parser_get_frame_len(
+    const chanmux_nic_rx_parser_t *parser)
+{
+    return parser->frame_len;
+}
+
+/**
+ * @details get the first bytes of the current frame, see
+ *  chanmux_nic_rx_parser_set_peek_len(). They are valid when
+ *  CHANMUX_NIC_RX_PARSER_NEED_BUFFER was returned for the first buffer of a
+ *  frame, until the buffer is set.
+ *
+ * @param parser the parser
+ * @param len receives the number of bytes, less than the peek length only if
+ *  the frame is shorter
+ *
+ * @retval the frame bytes
+ */
+static inline const uint8_t *
+chanmux_nic_rx_parser_get_peek(
+    const chanmux_nic_rx_parser_t *parser,
+    size_t *len)
+{
+    *len = parser->peek_bytes;
+    return parser->peek;
+}
+
+/**
+ * @details check if a frame is complete without further input. This happens
+ *  if the whole frame was collected before the buffer was set or the frame
+ *  was skipped, see chanmux_nic_rx_parser_set_peek_len(). The caller must feed
+ *  the parser then, even if there is no data, to get the frame event.
+ *
+ * @param parser the parser
+ *
+ * @retval true if the parser has a complete frame to report
+ */
+static inline bool
+chanmux_nic_rx_parser_has_pending_frame(
+    const chanmux_nic_rx_parser_t *parser)
+{
+    return (CHANMUX_NIC_RX_PARSER_STATE_DATA == parser->state) &&
+           (parser->frame_offset == parser->frame_len);
+}
+
+/**
+ * @details get the partial IP checksum sum of the frame data, see
+ *  chanmux_nic_csum.h. It is complete when CHANMUX_NIC_RX_PARSER_FRAME was
+ *  returned and valid until the next frame starts.
+ *
+ * @param parser the parser
+ *
+ * @retval partial sum of the frame
+ */
+static inline uint64_t
+chanmux_nic_rx_parser_get_csum(
+    const chanmux_nic_rx_parser_t *parser)
+{
+    return parser->csum_sum;
+}
+
+/**
+ * @details get the number of frame bytes in the current buffer
+ *
+ * @param parser the parser
+ *
+ * @retval number of bytes
+ */
+static inline size_t
+chanmux_nic_rx_parser_get_buffer_len(
+    const chanmux_nic_rx_parser_t *parser)
+{
+    return parser->buf_offset;
+}
+
+/**
+ * @details get the number of frames lost since the last call, as seen from
+ *  the v2 sequence numbers. Corrupted frames are included.
+ *
+ * @param parser the parser
+ *
+ * @retval number of lost frames
+ */
+static inline uint64_t
+chanmux_nic_rx_parser_take_lost_frames(
+    chanmux_nic_rx_parser_t *parser)
+{
+    uint64_t lost_frames = parser->lost_frames;
+    parser->lost_frames = 0;
+    return lost_frames;
+}
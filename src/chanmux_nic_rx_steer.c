@@ -0,0 +1,208 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX flow steering
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "lib_debug/Debug.h"
+#include "chanmux_nic_rx_steer.h"
+#include "chanmux_nic_drv.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// the usual RSS key, so the hash matches what other systems calculate
+static const uint8_t rx_steer_default_key[CHANMUX_NIC_DRV_RX_STEER_KEY_LEN] =
+{
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_rx_steer_init(
+    chanmux_nic_drv_t *ctx)
+{
+    // an all zero key means the default key
+    const uint8_t *key = rx_steer_default_key;
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_RX_STEER_KEY_LEN; i++)
+    {
+        if (0 != ctx->config->rx.steering.hash_key[i])
+        {
+            key = ctx->config->rx.steering.hash_key;
+            break;
+        }
+    }
+
+    // Each set input bit adds the 32 key bits starting at its position. The
+    // table has the sum for each nibble value at each input position, so the
+    // hash needs two lookups per input byte instead of a loop over the bits.
+    for (unsigned int n = 0; n < CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES; n++)
+    {
+        uint32_t window[4];
+        for (unsigned int b = 0; b < 4; b++)
+        {
+            unsigned int bit = n * 4 + b;
+            unsigned int byte = bit / 8;
+            unsigned int shift = bit % 8;
+            uint64_t bits = ((uint64_t)key[byte] << 32) |
+                            ((uint64_t)key[byte + 1] << 24) |
+                            ((uint64_t)key[byte + 2] << 16) |
+                            ((uint64_t)key[byte + 3] << 8) |
+                            key[byte + 4];
+            window[b] = (uint32_t)(bits >> (8 - shift));
+        }
+        for (unsigned int v = 0; v < 16; v++)
+        {
+            uint32_t sum = 0;
+            for (unsigned int b = 0; b < 4; b++)
+            {
+                if (v & (8U >> b))
+                {
+                    sum ^= window[b];
+                }
+            }
+            ctx->rx.steer_hash_table[n][v] = sum;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+uint32_t
+chanmux_nic_rx_steer_hash(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *data,
+    size_t len)
+{
+    Debug_ASSERT(len * 2 <= CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES);
+
+    uint32_t hash = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= ctx->rx.steer_hash_table[i * 2][data[i] >> 4];
+        hash ^= ctx->rx.steer_hash_table[i * 2 + 1][data[i] & 0x0F];
+    }
+
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+// Get the addresses and, if there is no fragmentation or IPv6 extension header
+// in the way, the TCP/UDP ports. Returns the tuple length, 0 if this is not
+// an IP frame.
+static size_t
+rx_steer_get_tuple(
+    const uint8_t *hdr,
+    size_t len,
+    uint16_t ethertype,
+    size_t l3,
+    uint8_t *tuple)
+{
+    size_t tuple_len = 0;
+    uint8_t proto;
+    size_t l4;
+
+    if ((ETHERTYPE_IPV4 == ethertype) && (len >= l3 + 20))
+    {
+        memcpy(tuple, &hdr[l3 + 12], 8);
+        tuple_len = 8;
+        proto = hdr[l3 + 9];
+        l4 = l3 + (hdr[l3] & 0x0F) * 4;
+        // only the first fragment has the ports
+        if (0 != (get_be16(&hdr[l3 + 6]) & 0x3FFF))
+        {
+            return tuple_len;
+        }
+    }
+    else if ((ETHERTYPE_IPV6 == ethertype) && (len >= l3 + 40))
+    {
+        memcpy(tuple, &hdr[l3 + 8], 32);
+        tuple_len = 32;
+        proto = hdr[l3 + 6];
+        l4 = l3 + 40;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (((IP_PROTO_TCP == proto) || (IP_PROTO_UDP == proto)) && (len >= l4 + 4))
+    {
+        memcpy(&tuple[tuple_len], &hdr[l4], 4);
+        tuple_len += 4;
+    }
+
+    return tuple_len;
+}
+
+//------------------------------------------------------------------------------
+unsigned int
+chanmux_nic_rx_steer(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *hdr,
+    size_t len)
+{
+    const unsigned int clients = ctx->rx.clients;
+    if ((clients <= 1) || (len < ETH_HDR_LEN))
+    {
+        return 0;
+    }
+
+    const chanmux_nic_drv_config_t *config = ctx->config;
+    size_t l3 = ETH_HDR_LEN;
+    uint16_t ethertype = get_be16(&hdr[12]);
+    bool tagged = ((ETHERTYPE_VLAN == ethertype) &&
+                   (len >= ETH_HDR_LEN + ETH_VLAN_TAG_LEN));
+    uint16_t vlan_id = 0;
+    if (tagged)
+    {
+        vlan_id = get_be16(&hdr[14]) & 0x0FFF;
+        ethertype = get_be16(&hdr[16]);
+        l3 += ETH_VLAN_TAG_LEN;
+    }
+
+    for (unsigned int i = 0; i < CHANMUX_NIC_DRV_RX_STEER_RULES_MAX; i++)
+    {
+        const chanmux_nic_drv_steer_rule_t *rule = &config->rx.steering.rules[i];
+        bool match = false;
+        switch (rule->match)
+        {
+        case CHANMUX_NIC_DRV_STEER_VLAN_ID:
+            match = tagged && (rule->value == vlan_id);
+            break;
+        case CHANMUX_NIC_DRV_STEER_ETHERTYPE:
+            match = (rule->value == ethertype);
+            break;
+        case CHANMUX_NIC_DRV_STEER_DST_MAC:
+            match = (0 == memcmp(hdr, rule->mac, MAC_SIZE));
+            break;
+        default:
+            break;
+        }
+        if (match)
+        {
+            return (rule->client < clients) ? rule->client : 0;
+        }
+    }
+
+    if (!config->rx.steering.hash)
+    {
+        return 0;
+    }
+
+    uint8_t tuple[CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES / 2];
+    size_t tuple_len = rx_steer_get_tuple(hdr, len, ethertype, l3, tuple);
+    if (0 == tuple_len)
+    {
+        return 0;
+    }
+
+    return chanmux_nic_rx_steer_hash(ctx, tuple, tuple_len) % clients;
+}
@@ -0,0 +1,64 @@
+/*
+ * ChanMUX Ethernet TAP driver, RX flow steering
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include "chanmux_nic_drv_api.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes at the start of a frame the steering looks at. This covers the
+// Ethernet header with a VLAN tag, an IPv6 header and the TCP/UDP ports.
+#define CHANMUX_NIC_RX_STEER_HDR_LEN    64
+
+/**
+ * @details pick the network stack client for a frame. The configured rules
+ *  are checked in order, the first match decides. IP frames no rule matches
+ *  are spread over the clients by a Toeplitz hash of the addresses and the
+ *  TCP/UDP ports if hashing is enabled, so all frames of a flow go to the same
+ *  client. Everything else goes to client 0.
+ *
+ * @param ctx driver context
+ * @param hdr start of the frame
+ * @param len bytes at hdr, CHANMUX_NIC_RX_STEER_HDR_LEN or the frame length
+ *  if it is shorter
+ *
+ * @retval client index
+ */
+unsigned int
+chanmux_nic_rx_steer(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *hdr,
+    size_t len);
+
+/**
+ * @details set up the hash table from the configured key
+ *
+ * @param ctx driver context
+ */
+void
+chanmux_nic_rx_steer_init(
+    chanmux_nic_drv_t *ctx);
+
+/**
+ * @details calculate the Toeplitz hash used for receive side scaling
+ *
+ * @param ctx driver context, chanmux_nic_rx_steer_init() must have been called
+ * @param data input, the source and destination address followed by the
+ *  source and destination port, all in network byte order
+ * @param len length of the input, max CHANMUX_NIC_DRV_RX_STEER_HASH_NIBBLES / 2
+ *
+ * @retval hash value
+ */
+uint32_t
+chanmux_nic_rx_steer_hash(
+    const chanmux_nic_drv_t *ctx,
+    const uint8_t *data,
+    size_t len);
@@ -0,0 +1,167 @@
+/*
+ * ChanMUX Ethernet TAP driver, TX segmentation offload
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "chanmux_nic_tx_tso.h"
+#include "chanmux_nic_drv.h"
+#include "chanmux_nic_csum.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define IPV6_HDR_LEN    40
+
+//------------------------------------------------------------------------------
+static void
+set_be16(
+    uint8_t *p,
+    uint16_t v)
+{
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+bool
+chanmux_nic_tx_tso_init(
+    chanmux_nic_tx_tso_t *tso,
+    const uint8_t *frame,
+    size_t len,
+    size_t mss)
+{
+    size_t ip = ETH_HDR_LEN;
+    if ((0 == mss) || (len < ip))
+    {
+        return false;
+    }
+    uint16_t ethertype = get_be16(&frame[ip - 2]);
+    if (ETHERTYPE_VLAN == ethertype)
+    {
+        ip += ETH_VLAN_TAG_LEN;
+        if (len < ip)
+        {
+            return false;
+        }
+        ethertype = get_be16(&frame[ip - 2]);
+    }
+
+    size_t ip_len;
+    uint8_t proto;
+    tso->ip = ip;
+    if ((ETHERTYPE_IPV4 == ethertype) && (len >= ip + 20))
+    {
+        tso->ip_hdr_len = (frame[ip] & 0x0F) * 4;
+        ip_len = get_be16(&frame[ip + 2]);
+        if ((0x40 != (frame[ip] & 0xF0)) || (tso->ip_hdr_len < 20) ||
+            (ip_len < tso->ip_hdr_len) ||
+            (0 != (get_be16(&frame[ip + 6]) & 0x3FFF)))
+        {
+            return false;
+        }
+        proto = frame[ip + 9];
+        tso->tcp = ip + tso->ip_hdr_len;
+        tso->ip_id = get_be16(&frame[ip + 4]);
+    }
+    else if ((ETHERTYPE_IPV6 == ethertype) && (len >= ip + IPV6_HDR_LEN))
+    {
+        tso->ip_hdr_len = 0;
+        ip_len = IPV6_HDR_LEN + get_be16(&frame[ip + 4]);
+        proto = frame[ip + 6];
+        tso->tcp = ip + IPV6_HDR_LEN;
+        tso->ip_id = 0;
+    }
+    else
+    {
+        return false;
+    }
+
+    if ((IP_PROTO_TCP != proto) || (ip + ip_len > len) ||
+        (tso->tcp + 20 > ip + ip_len))
+    {
+        return false;
+    }
+    const size_t tcp_hdr_len = (frame[tso->tcp + 12] >> 4) * 4;
+    tso->hdr_len = tso->tcp + tcp_hdr_len;
+    tso->flags = frame[tso->tcp + 13];
+    if ((tcp_hdr_len < 20) || (tso->hdr_len > ip + ip_len) ||
+        (0 != (tso->flags & (TCP_FLAG_SYN | TCP_FLAG_RST | TCP_FLAG_URG))))
+    {
+        return false;
+    }
+
+    // Ethernet padding behind the IP packet is not sent
+    tso->payload_len = ip + ip_len - tso->hdr_len;
+    if (tso->payload_len <= mss)
+    {
+        return false;
+    }
+    tso->mss = mss;
+    tso->segs = (tso->payload_len + mss - 1) / mss;
+    tso->seq = get_be32(&frame[tso->tcp + 4]);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+chanmux_nic_tx_tso_set_hdr(
+    const chanmux_nic_tx_tso_t *tso,
+    uint8_t *hdr,
+    size_t i,
+    uint64_t payload_sum)
+{
+    const size_t ip = tso->ip;
+    const size_t tcp = tso->tcp;
+    const size_t tcp_len = chanmux_nic_tx_tso_get_len(tso, i) - tcp;
+    uint64_t sum;
+
+    if (tso->ip_hdr_len > 0)
+    {
+        set_be16(&hdr[ip + 2], tso->ip_hdr_len + tcp_len);
+        set_be16(&hdr[ip + 4], tso->ip_id + i);
+        memset(&hdr[ip + 10], 0, 2);
+        uint16_t csum = ~chanmux_nic_csum_fold(
+                            chanmux_nic_csum_partial(&hdr[ip], tso->ip_hdr_len, 0));
+        memcpy(&hdr[ip + 10], &csum, sizeof(csum));
+        sum = chanmux_nic_csum_partial(&hdr[ip + 12], 8, 0);
+    }
+    else
+    {
+        set_be16(&hdr[ip + 4], tcp_len);
+        sum = chanmux_nic_csum_partial(&hdr[ip + 8], 32, 0);
+    }
+
+    // sequence number and flags, the checksum is calculated below
+    uint32_t seq = tso->seq + i * tso->mss;
+    hdr[tcp + 4] = (seq >> 24) & 0xFF;
+    hdr[tcp + 5] = (seq >> 16) & 0xFF;
+    hdr[tcp + 6] = (seq >> 8) & 0xFF;
+    hdr[tcp + 7] = seq & 0xFF;
+    uint8_t flags = tso->flags;
+    if (i > 0)
+    {
+        flags &= ~TCP_FLAG_CWR;
+    }
+    if (i + 1 < tso->segs)
+    {
+        flags &= ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+    }
+    hdr[tcp + 13] = flags;
+    memset(&hdr[tcp + 16], 0, 2);
+
+    // pseudo header, the addresses, zero, protocol and the TCP length. The
+    // TCP header length is a multiple of 4, so the payload starts at an even
+    // offset.
+    uint8_t pseudo[4] = { 0, IP_PROTO_TCP, (tcp_len >> 8) & 0xFF, tcp_len & 0xFF };
+    sum = chanmux_nic_csum_partial(pseudo, sizeof(pseudo), sum);
+    sum = chanmux_nic_csum_partial(&hdr[tcp], tso->hdr_len - tcp, sum);
+    uint16_t csum = ~chanmux_nic_csum_fold(chanmux_nic_csum_add(sum, payload_sum,
+                                                                false));
+    memcpy(&hdr[tcp + 16], &csum, sizeof(csum));
+}
@@ -0,0 +1,89 @@
+/*
+ * ChanMUX Ethernet TAP driver, TX segmentation offload
+ *
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest headers TSO copies into each segment. This covers the Ethernet
+// header with a VLAN tag, an IPv4 header with options and the largest TCP
+// header.
+#define CHANMUX_NIC_TX_TSO_HDR_MAX      (14 + 4 + 60 + 60)
+
+// a TCP segment to split, and where its headers are
+typedef struct
+{
+    size_t ip;          // IP header
+    size_t ip_hdr_len;  // IPv4 header length, 0 for IPv6
+    size_t tcp;         // TCP header
+    size_t hdr_len;     // all headers, each segment gets a copy
+    size_t payload_len; // TCP payload of the whole segment
+    size_t mss;         // max TCP payload per segment
+    size_t segs;        // number of segments
+    uint16_t ip_id;     // IPv4 ID of the first segment
+    uint32_t seq;       // TCP sequence number of the first segment
+    uint8_t flags;      // TCP flags
+} chanmux_nic_tx_tso_t;
+
+/**
+ * @details check if a frame is a TCP segment that must be split. It must be
+ *  IPv4 or IPv6 without extension headers, not a fragment, and carry more
+ *  than mss bytes of payload. SYN, RST and URG segments are not split.
+ *
+ * @param tso receives the segment
+ * @param frame the frame
+ * @param len length of the frame
+ * @param mss max TCP payload per segment
+ *
+ * @retval true if the frame must be split
+ */
+bool
+chanmux_nic_tx_tso_init(
+    chanmux_nic_tx_tso_t *tso,
+    const uint8_t *frame,
+    size_t len,
+    size_t mss);
+
+/**
+ * @details get the length of a segment
+ *
+ * @param tso the segment to split
+ * @param i number of the segment
+ *
+ * @retval frame length of the segment
+ */
+static inline size_t
+chanmux_nic_tx_tso_get_len(
+    const chanmux_nic_tx_tso_t *tso,
+    size_t i)
+{
+    size_t payload_len = tso->payload_len - i * tso->mss;
+    return tso->hdr_len + ((payload_len > tso->mss) ? tso->mss : payload_len);
+}
+
+/**
+ * @details set up the headers of a segment, the IP length and ID, the TCP
+ *  sequence number and flags and all checksums. The TCP flags of the whole
+ *  segment are kept, but CWR goes with the first and FIN and PSH with the
+ *  last segment only.
+ *
+ * @param tso the segment to split
+ * @param hdr copy of the headers of the whole segment
+ * @param i number of the segment
+ * @param payload_sum partial sum of the payload of the segment
+ */
+void
+chanmux_nic_tx_tso_set_hdr(
+    const chanmux_nic_tx_tso_t *tso,
+    uint8_t *hdr,
+    size_t i,
+    uint64_t payload_sum);